@@ -0,0 +1,272 @@
+// advise.c ... recommend a choice vector for a query workload
+// part of Multi-attribute linear-hashed files
+// Reads a log of queries (one per line, in the form select takes)
+//   and finds a choice vector for the relation that makes them
+//   read as few pages as it can
+// Usage:  ./advise  [-v]  RelName  <  QueryLog
+// -v shows the expected pages for each kind of query
+//
+// Bits are allocated greedily: each position in the choice vector
+//   goes to the attribute whose next bit most reduces the total
+//   expected pages read by the workload
+// An attribute with D distinct values gets at most log2(D) bits,
+//   since more bits can't spread its values over more buckets
+// Only the d+1 positions the file uses now are allocated; the
+//   rest are filled in by create/rechvec as usual (re-run this
+//   once the file has grown)
+// #distinct values come from the relation's statistics (see
+//   sketch.h), or from a scan if it doesn't have any
+
+#include "defs.h"
+#include "reln.h"
+#include "page.h"
+#include "chvec.h"
+
+#define USAGE "./advise  [-v]  RelName  <  QueryLog"
+
+// what the cost model knows about the relation
+typedef struct {
+	Count  nattrs;
+	Count  depth;
+	Count  sp;
+	double pages;              // #pages holding all the tuples
+	double distinct[MAXATTRS]; // #distinct values of each attribute
+} Shape;
+
+static void scanRelation(Reln r, Shape *s);
+static void shapeFromStats(Reln r, AttrStats *st, Shape *s);
+static double queryCost(Shape *s, ChVecItem *cv, Count len, Bits known);
+static double workloadCost(Shape *s, ChVecItem *cv, Count len, Count *freq);
+static void showPattern(Count nattrs, Bits known);
+
+// Main ... process args, read queries, allocate bits
+
+int main(int argc, char **argv)
+{
+	char err[MAXERRMSG];  // buffer for error messages
+	char line[MAXTUPLEN+2];  // query from the log
+	int verbose;  // show cost of each kind of query
+	char *rname;  // name of table/file
+
+	// process command-line args
+
+	if (argc < 2) fatal(USAGE);
+	if (strcmp(argv[1], "-v") == 0) {
+		if (argc < 3) fatal(USAGE);
+		verbose = 1;  rname = argv[2];
+	}
+	else {
+		verbose = 0;  rname = argv[1];
+	}
+
+	if (!existsRelation(rname)) {
+		sprintf(err, "No such relation: %s",rname);
+		fatal(err);
+	}
+	Reln r = openRelation(rname,"r");
+	if (r == NULL) {
+		sprintf(err, "Can't open relation: %s",rname);
+		fatal(err);
+	}
+	Count n = nattrs(r);
+
+	// how often each set of attributes is known
+
+	Count *freq = calloc(1u << n, sizeof(Count));
+	assert(freq != NULL);
+	Count nqueries = 0;
+	while (fgets(line, MAXTUPLEN+2, stdin) != NULL) {
+		line[strcspn(line, "\n")] = '\0';
+		if (line[0] == '\0') continue;
+		Bits known = 0;
+		Count a = 0;
+		for (char *c = strtok(line, ","); c != NULL; c = strtok(NULL, ",")) {
+			if (a < n && strcmp(c, "?") != 0) known |= 1u << a;
+			a++;
+		}
+		if (a != n) {
+			fprintf(stderr, "Skipping invalid query\n");
+			continue;
+		}
+		freq[known]++;
+		nqueries++;
+	}
+	if (nqueries == 0) fatal("No queries in log");
+
+	Shape s;
+	AttrStats *st = loadStats(r);
+	if (st != NULL) {
+		shapeFromStats(r, st, &s);
+		free(st);
+	}
+	else
+		scanRelation(r, &s);
+	Count len = s.depth+1;
+	ChVecItem *now = chvec(r);
+
+	// greedy allocation, one position at a time
+
+	ChVecItem best[MAXCHVEC];
+	Count used[MAXATTRS], cap[MAXATTRS];
+	for (Count a = 0; a < n; a++) {
+		used[a] = 0;
+		for (cap[a] = 0; (1ULL << cap[a]) < s.distinct[a]; cap[a]++) ;
+	}
+	for (Count i = 0; i < len; i++) {
+		int pick = -1;
+		double pickCost = 0;
+		for (Count a = 0; a < n; a++) {
+			if (used[a] >= cap[a]) continue;
+			best[i].att = a;  best[i].bit = used[a];
+			double c = workloadCost(&s, best, i+1, freq);
+			// on a tie, spread bits over the attributes
+			if (pick < 0 || c < pickCost
+			    || (c == pickCost && used[a] < used[pick])) {
+				pick = a;  pickCost = c;
+			}
+		}
+		// every attribute is at its cap; carry on round-robin
+		if (pick < 0) pick = i % n;
+		best[i].att = pick;  best[i].bit = used[pick]++;
+	}
+
+	printf("Queries: %d\n", nqueries);
+	printf("Distinct values:");
+	for (Count a = 0; a < n; a++) printf(" %.0f", s.distinct[a]);
+	printf("\n");
+	if (verbose) {
+		printf("%-*s %8s %10s %10s\n", 2*n, "query", "#queries", "current", "proposed");
+		for (Bits k = 0; k < (1u << n); k++) {
+			if (freq[k] == 0) continue;
+			showPattern(n, k);
+			printf(" %8d %10.1f %10.1f\n", freq[k],
+			       queryCost(&s, now, len, k), queryCost(&s, best, len, k));
+		}
+	}
+	printf("Expected pages per query: current %.1f, proposed %.1f\n",
+	       workloadCost(&s, now, len, freq)/nqueries,
+	       workloadCost(&s, best, len, freq)/nqueries);
+	printf("Recommended choice vector: ");
+	for (Count i = 0; i < len; i++)
+		printf("%d,%d%s", best[i].att, best[i].bit, (i+1 < len) ? ":" : "\n");
+
+	free(freq);
+	closeRelation(r);
+
+	return 0;
+}
+
+static int cmpBits(const void *a, const void *b)
+{
+	Bits x = *(Bits *)a, y = *(Bits *)b;
+	return (x > y) - (x < y);
+}
+
+// count pages and the distinct values (by hash) of each attribute
+
+static void scanRelation(Reln r, Shape *s)
+{
+	Count n = nattrs(r), nt = 0, max = 1024, np = 0;
+	Bits *h[MAXATTRS];
+	for (Count a = 0; a < n; a++) {
+		h[a] = malloc(max*sizeof(Bits));
+		assert(h[a] != NULL);
+	}
+	char *vals[MAXATTRS];
+	for (PageID b = 0; b < npages(r); b++) {
+		Page *pgs;
+		Count npg = readBucket(r, b, bucketDepth(r,b), &pgs);
+		for (Count i = 0; i < npg; i++) {
+			char *t = pageData(pgs[i]);
+			for (Count j = 0; j < pageNTuples(pgs[i]); j++, t += strlen(t)+1) {
+				if (t[0] == TOMBSTONE) continue;
+				if (nt == max) {
+					max *= 2;
+					for (Count a = 0; a < n; a++) {
+						h[a] = realloc(h[a], max*sizeof(Bits));
+						assert(h[a] != NULL);
+					}
+				}
+				tupleVals(t, vals);
+				for (Count a = 0; a < n; a++)
+					h[a][nt] = hashfn(r)((unsigned char *)vals[a], strlen(vals[a]));
+				for (Count a = 0; a < n; a++) free(vals[a]);
+				nt++;
+			}
+			free(pgs[i]);
+		}
+		np += npg;
+		free(pgs);
+	}
+	for (Count a = 0; a < n; a++) {
+		qsort(h[a], nt, sizeof(Bits), cmpBits);
+		Count d = (nt > 0) ? 1 : 0;
+		for (Count i = 1; i < nt; i++) d += (h[a][i] != h[a][i-1]);
+		s->distinct[a] = d;
+		free(h[a]);
+	}
+	s->nattrs = n;
+	s->depth = depth(r);
+	s->sp = splitp(r);
+	s->pages = np;
+}
+
+// as for scanRelation(), but only reading page headers
+
+static void shapeFromStats(Reln r, AttrStats *st, Shape *s)
+{
+	s->nattrs = nattrs(r);
+	s->depth = depth(r);
+	s->sp = splitp(r);
+	s->pages = 0;
+	for (PageID b = 0; b < npages(r); b++) s->pages += chainLength(r, b);
+	for (Count a = 0; a < s->nattrs; a++) s->distinct[a] = statsDistinct(&st[a]);
+}
+
+// expected #pages read by a query knowing the attributes in
+// 'known', if only the first len items of cv were used
+// - buckets: each known bit halves the candidates; unsplit
+//   buckets use bits 0..d-1, split ones bit d as well
+// - but they hold at least the fraction of the tuples whose
+//   known attributes hash to the query's bits, which for an
+//   attribute with D values and b bits is (1+(D-1)/2^b)/D
+
+static double queryCost(Shape *s, ChVecItem *cv, Count len, Bits known)
+{
+	Count k = 0, bits[MAXATTRS] = {0};
+	for (Count i = 0; i < s->depth && i < len; i++) {
+		if (!bitAt(known, cv[i].att)) continue;
+		k++;
+		bits[cv[i].att]++;
+	}
+	Count kd = k;
+	if (s->depth < len && bitAt(known, cv[s->depth].att)) kd++;
+	double buckets = (double)((1u << s->depth) - s->sp) / (1ULL << k)
+	               + 2.0*s->sp / (1ULL << kd);
+
+	double f = 1;
+	for (Count a = 0; a < s->nattrs; a++) {
+		if (!bitAt(known, a)) continue;
+		double D = (s->distinct[a] > 1) ? s->distinct[a] : 1;
+		f *= (1 + (D-1)/(1ULL << bits[a])) / D;
+	}
+	return (buckets > f*s->pages) ? buckets : f*s->pages;
+}
+
+// total expected #pages for all of the queries
+
+static double workloadCost(Shape *s, ChVecItem *cv, Count len, Count *freq)
+{
+	double total = 0;
+	for (Bits k = 0; k < (1u << s->nattrs); k++)
+		if (freq[k] > 0) total += freq[k]*queryCost(s, cv, len, k);
+	return total;
+}
+
+// e.g. "v,?,v" for a query knowing attributes 0 and 2
+
+static void showPattern(Count nattrs, Bits known)
+{
+	for (Count a = 0; a < nattrs; a++)
+		printf("%s%c", (a > 0) ? "," : "", bitAt(known, a) ? 'v' : '?');
+}
@@ -0,0 +1,135 @@
+// bench_bits.c ... check and time the inline bit kernels
+// part of Multi-attribute Linear-hashed Files
+// Checks lowerBits(), bitAt() and nextAgreeing() (bits.h) against
+//   the loop-and-mask code they replaced, for every value and
+//   every n (including n == 0) or position, then times them
+// Usage:  ./bench_bits  [#calls]
+// #calls is per timed kernel (default 10^8)
+// The checks sweep 65 x 2^32 cases, so take a minute or two
+// Exits 1 if any check fails
+
+#define _POSIX_C_SOURCE 200112L
+#include <time.h>
+#include "defs.h"
+#include "bits.h"
+
+#define USAGE "./bench_bits  [#calls]"
+
+// bits (of x, fixed, want) in the nextAgreeing() check
+#define AGREEBITS 10
+
+// the original getLower(), without its assert, so n can be 0
+static Bits oldLower(Bits b, int n)
+{
+	int i; Bits mask = 0;
+	for (i = 0; i < n; i++) mask |= (1u<<i);
+	return b&mask;
+}
+
+// the original bitIsSet(), without its assert
+static int oldIsSet(Bits val, int position)
+{
+	Bits mask = (1u << position);
+	return ((val & mask) != 0);
+}
+
+// smallest value > x agreeing with want on fixed, the slow way
+static Bits oldAgreeing(Bits x, Bits fixed, Bits want)
+{
+	do x++; while ((x & fixed) != want);
+	return x;
+}
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec/1e9;
+}
+
+static volatile Bits sink;  // keeps timed results from being dropped
+
+int main(int argc, char **argv)
+{
+	long long ncalls = 100000000;
+	char err[MAXERRMSG];
+	if (argc > 2) fatal(USAGE);
+	if (argc == 2) {
+		ncalls = atoll(argv[1]);
+		if (ncalls < 1) {
+			sprintf(err, "Invalid #calls: %.50s", argv[1]);
+			fatal(err);
+		}
+	}
+	int bad = 0;
+
+	// every (value,n): lowerBits(b,n) is b & mask, so any difference
+	//   from the old mask shows up in some value, but try them all
+	// (split into 16-bit halves so the inner loops vectorise)
+	for (int n = 0; n <= 32; n++) {
+		Bits mask = oldLower(~0u, n), diff = 0;
+		for (Bits hi = 0; hi < (1u << 16); hi++)
+			for (Bits lo = 0; lo < (1u << 16); lo++) {
+				Bits b = (hi << 16) | lo;
+				diff |= lowerBits(b, n) ^ (b & mask);
+			}
+		if (diff != 0 || (n > 0 && getLower(~0u, n) != mask)) {
+			printf("lowerBits(b,%d) differs from getLower()\n", n);
+			bad = 1;
+		}
+	}
+	// every (value,position)
+	for (int i = 0; i < 32; i++) {
+		Bits diff = 0;
+		for (Bits hi = 0; hi < (1u << 16); hi++)
+			for (Bits lo = 0; lo < (1u << 16); lo++) {
+				Bits b = (hi << 16) | lo;
+				diff |= bitAt(b, i) ^ oldIsSet(b, i);
+			}
+		if (diff != 0 || bitAt(~0u, i) != bitIsSet(~0u, i)
+		    || bitAt(0, i) != bitIsSet(0, i)) {
+			printf("bitAt(b,%d) differs from bitIsSet()\n", i);
+			bad = 1;
+		}
+	}
+	// every (x,fixed,want) in the lower AGREEBITS bits, with want
+	//   within fixed, and x agreeing with it (as in the scans)
+	Count nagree = 0;
+	for (Bits fixed = 0; fixed < (1u << AGREEBITS); fixed++) {
+		Bits free = ((1u << AGREEBITS) - 1) & ~fixed;
+		for (Bits want = fixed; ; want = (want - 1) & fixed) {
+			for (Bits s = 0; ; s = ((s | ~free) + 1) & free, nagree++) {
+				Bits x = s | want;
+				if (nextAgreeing(x, fixed, want) != oldAgreeing(x, fixed, want)) {
+					printf("nextAgreeing(%u,%u,%u) is wrong\n", x, fixed, want);
+					bad = 1;
+				}
+				if (s == free) break;
+			}
+			if (want == 0) break;
+		}
+	}
+	printf("checked lowerBits and bitAt on all 2^32 values, nextAgreeing on %d cases: %s\n",
+	       nagree, bad ? "FAILED" : "ok");
+
+	// time each kernel against the code it replaced
+	double t;  Bits acc = 0;
+	printf("ns per call (%lld calls):\n", ncalls);
+#define TIME(name, expr) \
+	acc = 0; t = now(); \
+	for (long long k = 0; k < ncalls; k++) { Bits b = (Bits)k * 2654435761u; acc += (expr); } \
+	sink = acc; \
+	printf("  %-28s %6.2f\n", name, (now() - t)*1e9/ncalls);
+
+	TIME("oldLower (mask loop)", oldLower(b, (int)(k & 31) + 1))
+	TIME("getLower (checked)", getLower(b, (int)(k & 31) + 1))
+	TIME("lowerBits", lowerBits(b, (int)(k & 31) + 1))
+	TIME("bitIsSet (checked)", bitIsSet(b, (int)(k & 31)))
+	TIME("bitAt", bitAt(b, (int)(k & 31)))
+	TIME("oldAgreeing (step by 1)", oldAgreeing((b & 0x0f0f) | (b & 0x3030), 0xf0f0, b & 0x3030))
+	TIME("nextAgreeing", nextAgreeing((b & 0x0f0f) | (b & 0x3030), 0xf0f0, b & 0x3030))
+	TIME("countBits", countBits(b))
+#undef TIME
+
+	return bad;
+}
@@ -0,0 +1,157 @@
+// bench_hash.c ... compare the hash functions
+// part of Multi-attribute Linear-hashed Files
+// Checks that the SSE4.2 and table-driven CRC32C agree, then for
+//   each hash function (hash.h) and each of three sets of keys,
+//   prints ns per key and how evenly the keys fall into buckets
+// Usage:  ./bench_hash  [#keys]
+// #keys is per key set (default 10^5); keys are:
+//   ids ... "1", "2", ... as in tuples' first attribute
+//   words ... random lower-case words of 3..12 letters
+//   long ... 40-byte keys that differ only in a few digits
+// Variance is of the keys per bucket over NBUCKETS buckets
+//   (picked by the lower bits, as linear hashing does); for
+//   random placement variance/mean is about 1
+// Exits 1 if the CRC32C paths disagree
+
+#define _POSIX_C_SOURCE 200112L
+#include <time.h>
+#include "defs.h"
+#include "hash.h"
+
+#define USAGE "./bench_hash  [#keys]"
+
+#define NBUCKETS 1024     // buckets for the occupancy variance
+#define NHASHES  10000000 // hashes timed per function and key set
+#define MAXKEY   48
+
+typedef struct { char *name; char (*key)[MAXKEY]; int *len; } KeySet;
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec/1e9;
+}
+
+static volatile Bits sink;  // keeps timed results from being dropped
+
+// fill in the keys of each set
+
+static void makeKeys(KeySet *ks, int nkeys)
+{
+	for (int i = 0; i < nkeys; i++) {
+		ks[0].len[i] = sprintf(ks[0].key[i], "%d", i+1);
+		int n = 3 + rand()%10;
+		for (int j = 0; j < n; j++) ks[1].key[i][j] = 'a' + rand()%26;
+		ks[1].len[i] = n;
+		ks[2].len[i] = sprintf(ks[2].key[i],
+		                       "customer-record-%08d-region-north", i*7);
+	}
+}
+
+// check the two CRC32C paths on every length 0..256 at every
+//   alignment 0..7, and on every key; returns #disagreements
+
+static int checkCrc(KeySet *ks, int nsets, int nkeys, Count *nchecked)
+{
+	unsigned char buf[256+8];
+	Bits hard;
+	int bad = 0;
+	*nchecked = 0;
+	for (int i = 0; i < sizeof(buf); i++) buf[i] = rand();
+	for (int off = 0; off < 8; off++) {
+		for (int n = 0; n <= 256; n++) {
+			if (!crc32cSSE42(buf+off, n, &hard)) return 0;
+			if (hard != crc32cTable(buf+off, n)) {
+				printf("crc32c differs on %d bytes at offset %d\n", n, off);
+				bad++;
+			}
+			(*nchecked)++;
+		}
+	}
+	for (int s = 0; s < nsets; s++) {
+		for (int i = 0; i < nkeys; i++) {
+			unsigned char *k = (unsigned char *)ks[s].key[i];
+			crc32cSSE42(k, ks[s].len[i], &hard);
+			if (hard != crc32cTable(k, ks[s].len[i])) {
+				printf("crc32c differs on %s key %.*s\n",
+				       ks[s].name, ks[s].len[i], ks[s].key[i]);
+				bad++;
+			}
+			(*nchecked)++;
+		}
+	}
+	return bad;
+}
+
+int main(int argc, char **argv)
+{
+	int nkeys = 100000;
+	char err[MAXERRMSG];
+	if (argc > 2) fatal(USAGE);
+	if (argc == 2) {
+		nkeys = atoi(argv[1]);
+		if (nkeys < 1 || nkeys > 10000000) {
+			sprintf(err, "Invalid #keys: %.50s", argv[1]);
+			fatal(err);
+		}
+	}
+
+	KeySet ks[3] = { { "ids" }, { "words" }, { "long" } };
+	int nsets = 3;
+	for (int s = 0; s < nsets; s++) {
+		ks[s].key = malloc(nkeys * sizeof(*ks[s].key));
+		ks[s].len = malloc(nkeys * sizeof(int));
+		if (ks[s].key == NULL || ks[s].len == NULL)
+			fatal("Out of memory for keys");
+	}
+	srand(0);
+	makeKeys(ks, nkeys);
+
+	Count nchecked;
+	int bad = checkCrc(ks, nsets, nkeys, &nchecked);
+	if (nchecked == 0)
+		printf("no SSE4.2 on this CPU: crc32c uses the table\n");
+	else
+		printf("SSE4.2 and table crc32c on %d keys: %s\n",
+		       nchecked, bad ? "DIFFER" : "agree");
+
+	int reps = (NHASHES + nkeys - 1) / nkeys;
+	double mean = (double)nkeys / NBUCKETS;
+	printf("%-8s %-6s %8s %10s %9s\n",
+	       "hash", "keys", "ns/key", "variance", "var/mean");
+	for (int h = 0; h < NHASHFNS; h++) {
+		HashFn fn = hashFunction(h);
+		for (int s = 0; s < nsets; s++) {
+			// time the hashing alone, through the same pointer
+			//   the relation code calls
+			Bits acc = 0;
+			double t = now();
+			for (int r = 0; r < reps; r++)
+				for (int i = 0; i < nkeys; i++)
+					acc += fn((unsigned char *)ks[s].key[i], ks[s].len[i]);
+			t = now() - t;
+			sink = acc;
+
+			static Count bucket[NBUCKETS];
+			memset(bucket, 0, sizeof(bucket));
+			for (int i = 0; i < nkeys; i++) {
+				Bits b = fn((unsigned char *)ks[s].key[i], ks[s].len[i]);
+				bucket[b % NBUCKETS]++;
+			}
+			double var = 0;
+			for (int b = 0; b < NBUCKETS; b++)
+				var += (bucket[b] - mean) * (bucket[b] - mean);
+			var /= NBUCKETS;
+
+			printf("%-8s %-6s %8.2f %10.1f %9.2f\n", hashName(h), ks[s].name,
+			       t*1e9/((double)reps*nkeys), var, var/mean);
+		}
+	}
+
+	for (int s = 0; s < nsets; s++) {
+		free(ks[s].key);
+		free(ks[s].len);
+	}
+	return bad != 0;
+}
@@ -0,0 +1,69 @@
+// bitmap.c ... build or drop a bitmap index on an attribute
+// part of Multi-attribute linear-hashed files
+// Builds a bitmap index, RelName.bmp.Attr, on one attribute, from
+//   each value to a compressed bitmap of the hash slots of the
+//   tuples that have it; after that, inserts add to it, and
+//   select ANDs the bitmaps of the attributes a query knows (ORing
+//   those of the values in an IN-list) to find the buckets to
+//   read, when that reads fewer pages than the other ways
+// It suits attributes with few distinct values (e.g. words from
+//   a small vocabulary), which have few, dense bitmaps
+// Inserts are kept apart from the bitmaps, and each lookup reads
+//   all of them, so run it again after many inserts (or after
+//   rechvec) to fold them in
+// Usage:  ./bitmap  [--drop]  RelName  Attr
+// where Attr = attribute number (from 0)
+// --drop removes the index instead
+
+#include "defs.h"
+#include "reln.h"
+
+#define USAGE "./bitmap  [--drop]  RelName  Attr"
+
+// Main ... process args, build or drop the index
+
+int main(int argc, char **argv)
+{
+	char err[MAXERRMSG];  // buffer for error messages
+	int drop;     // drop the index instead of building it
+	char *rname;  // name of table/file
+
+	// process command-line args
+
+	if (argc < 3) fatal(USAGE);
+	drop = strcmp(argv[1], "--drop") == 0;
+	if (argc < 3 + drop) fatal(USAGE);
+	rname = argv[1+drop];
+	int a = atoi(argv[2+drop]);
+
+	if (!existsRelation(rname)) {
+		sprintf(err, "No such relation: %s",rname);
+		fatal(err);
+	}
+	Reln r = openRelation(rname,"r+");
+	if (r == NULL) {
+		sprintf(err, "Can't open relation: %s",rname);
+		fatal(err);
+	}
+	if (a < 0 || a >= nattrs(r)) {
+		sprintf(err, "Invalid attribute: %.50s", argv[2+drop]);
+		fatal(err);
+	}
+
+	// no inserts while the index is built; scans carry on
+
+	latchSplit(r, LOCK_EXCL);
+	if (drop)
+		dropBitmap(r, a);
+	else
+		buildBitmap(r, a);
+	unlatchSplit(r);
+	if (!drop) {
+		Count added, pages;
+		Count n = bitmapIndexSize(attrBitmap(r, a), &added, &pages);
+		printf("Built bitmaps for %d values of attribute %d (%d pages)\n", n, a, pages);
+	}
+	closeRelation(r);
+
+	return 0;
+}
@@ -50,9 +50,7 @@ Bits unsetBit(Bits val, int position)
 Bits getLower(Bits b, int n)
 {
 	assert(1 <= n && n <= 32);
-	int i; Bits mask = 0;
-	for (i = 0; i < n; i++) mask |= (1<<i);
-	return b&mask;
+	return lowerBits(b, n);
 }
 
 // convert 32-bit unsigned quantity to string
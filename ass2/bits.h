@@ -15,4 +15,41 @@ Bits unsetBit(Bits, int);
 Bits getLower(Bits, int);
 void bitsString(Bits, char *);
 
+// Unchecked inline versions for per-tuple and per-bucket loops
+// The functions above assert() their arguments; these don't,
+//  and none of them branches
+
+// lower-order n bits of b, for 0 <= n <= 32
+static inline Bits lowerBits(Bits b, int n)
+{
+	return b & (Bits)((1ULL << n) - 1);
+}
+
+// value (0 or 1) of the bit at position
+static inline int bitAt(Bits b, int position)
+{
+	return (b >> position) & 1;
+}
+
+// number of 1 bits, and position of the lowest 1 bit (b != 0)
+static inline int countBits(Bits b) { return __builtin_popcount(b); }
+static inline int lowestBit(Bits b) { return __builtin_ctz(b); }
+
+// smallest value > x that has the bits in "fixed" equal to "want"
+// starting from want, this steps through every setting of the
+//  unfixed bits in increasing order (want must be within fixed)
+static inline Bits nextAgreeing(Bits x, Bits fixed, Bits want)
+{
+	return (((x | fixed) + 1) & ~fixed) | want;
+}
+
+// b with its bits in the opposite order (bit 0 <-> bit 31)
+static inline Bits reverseBits(Bits b)
+{
+	b = ((b >> 1) & 0x55555555) | ((b & 0x55555555) << 1);
+	b = ((b >> 2) & 0x33333333) | ((b & 0x33333333) << 2);
+	b = ((b >> 4) & 0x0f0f0f0f) | ((b & 0x0f0f0f0f) << 4);
+	return __builtin_bswap32(b);
+}
+
 #endif
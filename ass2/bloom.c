@@ -0,0 +1,37 @@
+// bloom.c ... per-page Bloom filters
+// part of Multi-attribute Linear-hashed Files
+// A filter is BLOOMBYTES*8 bits; a value with hash h sets the
+//   BLOOMHASHES bits g, g+g2, g+2*g2, ... (double hashing) where
+//   g and g2 come from re-mixing h, since tuples in a bucket all
+//   share the bits of h that the choice vector takes
+
+#include "defs.h"
+#include "bloom.h"
+#include "hash.h"
+
+#define BLOOMBITS (BLOOMBYTES*8)
+
+// add a value (by its hash) to a filter
+
+void bloomAdd(Byte *filter, Bits hash)
+{
+	Bits g = fmix32(hash);
+	Bits g2 = (g >> 16) | 1;
+	for (int i = 0; i < BLOOMHASHES; i++, g += g2) {
+		Bits bit = g % BLOOMBITS;
+		filter[bit/8] |= 1 << (bit%8);
+	}
+}
+
+// could the filter hold the value with this hash?
+
+Bool bloomMayHave(Byte *filter, Bits hash)
+{
+	Bits g = fmix32(hash);
+	Bits g2 = (g >> 16) | 1;
+	for (int i = 0; i < BLOOMHASHES; i++, g += g2) {
+		Bits bit = g % BLOOMBITS;
+		if (!(filter[bit/8] & (1 << (bit%8)))) return FALSE;
+	}
+	return TRUE;
+}
@@ -0,0 +1,22 @@
+// bloom.h ... interface to per-page Bloom filters
+// part of Multi-attribute Linear-hashed Files
+// Each page of a relation has one small Bloom filter for each
+//   attribute, kept in R.bloom, holding the hashes of the values
+//   of that attribute on the page
+// A scan can skip a page whose filters don't have every value
+//   the query knows; they never say no to a value that's there
+// See bloom.c for details on functions
+
+#ifndef BLOOM_H
+#define BLOOM_H 1
+
+#include "defs.h"
+#include "bits.h"
+
+#define BLOOMBYTES  32  // bytes of filter per attribute per page
+#define BLOOMHASHES 3   // bits set for each value
+
+void bloomAdd(Byte *filter, Bits hash);
+Bool bloomMayHave(Byte *filter, Bits hash);
+
+#endif
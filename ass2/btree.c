@@ -0,0 +1,333 @@
+// btree.c ... B+-tree indexes
+// part of Multi-attribute Linear-hashed Files
+// Page 0 of the file holds the tree's Meta; the others are nodes
+// A node has a header (leaf?, #entries, link), then its entries
+//   packed one after another, each a Bits then a '\0'-terminated
+//   key, in key order
+// - in a leaf, each entry is a key and one of its values, and
+//   link is the next leaf (NO_PAGE for the last)
+// - in an internal node, entry i is a key and the child holding
+//   keys >= it (and < the next key), and link is the child with
+//   the keys before the first
+// Equal keys can spill over a split, so a search for a key starts
+//   in the child before any separator equal to it, then follows
+//   the leaves' links
+// Changes take an exclusive lock on the whole file, searches a
+//   shared one, so a tree can be shared between processes
+
+#include "defs.h"
+#include "btree.h"
+#include "hash.h"
+#include "lock.h"
+
+#define BTMAGIC   0x42547231  // "1rTB"
+#define NODEHDR   (2*sizeof(Count)+sizeof(PageID))
+#define NODESPACE (PAGESIZE-NODEHDR)
+// entries a node can have while it's being split (the smallest
+// entry is an empty key)
+#define MAXENTRIES (NODESPACE/(sizeof(Bits)+1)+2)
+
+struct BTreeRep {
+	FILE *f;
+};
+
+typedef struct {
+	Count  magic;
+	PageID root;
+	Count  npages;   // including this one
+	Count  height;   // 1 if the root is a leaf
+	Count  nentries;
+	Bits   stamp;    // as given to newBTree()
+} Meta;
+
+// a node as read into memory; keys point into the page read
+typedef struct {
+	Count  leaf;
+	Count  n;
+	PageID link;
+	char  *keys[MAXENTRIES];
+	Bits   ptrs[MAXENTRIES];
+} Node;
+
+static void readMeta(BTree t, Meta *m);
+static void writeMeta(BTree t, Meta *m);
+static void readNode(BTree t, PageID p, Node *nd, char *buf);
+static void writeNode(BTree t, PageID p, Node *nd, Count from, Count to, PageID link);
+static Count nodeBytes(Node *nd, Count from, Count to);
+static Bool insertUnder(BTree t, Meta *m, PageID p, char *key, Bits val,
+                        char **up, PageID *right, Bool *added);
+
+// make an empty tree in file fname, and open it for changes
+// stamp is kept with it, for the user to check it against later
+
+BTree newBTree(char *fname, Bits stamp)
+{
+	BTree t = malloc(sizeof(struct BTreeRep));
+	assert(t != NULL);
+	t->f = fopen(fname, "w+");
+	if (t->f == NULL) {
+		free(t);
+		return NULL;
+	}
+	setvbuf(t->f, NULL, _IONBF, 0);
+	Meta m = { BTMAGIC, 1, 2, 1, 0, stamp };
+	writeMeta(t, &m);
+	Node root;
+	root.leaf = TRUE;
+	root.n = 0;
+	writeNode(t, 1, &root, 0, 0, NO_PAGE);
+	return t;
+}
+
+// open an existing tree ("r", or "r+" to change it);
+// NULL if there isn't one
+
+BTree openBTree(char *fname, char *mode)
+{
+	FILE *f = fopen(fname, mode);
+	if (f == NULL) return NULL;
+	setvbuf(f, NULL, _IONBF, 0);
+	BTree t = malloc(sizeof(struct BTreeRep));
+	assert(t != NULL);
+	t->f = f;
+	return t;
+}
+
+void closeBTree(BTree t)
+{
+	fclose(t->f);
+	free(t);
+}
+
+FILE *btreeFile(BTree t) { return t->f; }
+
+Bits btreeStamp(BTree t)
+{
+	Meta m;
+	readMeta(t, &m);
+	return m.stamp;
+}
+
+// #entries, and #pages and height of the tree
+
+Count btreeSize(BTree t, Count *pages, Count *height)
+{
+	Meta m;
+	readMeta(t, &m);
+	*pages = m.npages;
+	*height = m.height;
+	return m.nentries;
+}
+
+// order of keys: ints first, by value, then others, by strcmp()
+
+int keyCompare(char *a, char *b)
+{
+	long long x, y;
+	Bool ia = intValue(a, &x), ib = intValue(b, &y);
+	if (ia && ib) return (x > y) - (x < y);
+	if (ia != ib) return ia ? -1 : 1;
+	return strcmp(a, b);
+}
+
+// add (key,val), unless the leaf it goes in already has it
+
+void btreeInsert(BTree t, char *key, Bits val)
+{
+	assert(strlen(key) < MAXTUPLEN);
+	lockRange(t->f, 0, 0, LOCK_EXCL, TRUE);
+	Meta m;
+	readMeta(t, &m);
+	char *up;
+	PageID right;
+	Bool added = FALSE;
+	if (insertUnder(t, &m, m.root, key, val, &up, &right, &added)) {
+		// the root split; a new root above the two halves
+		Node root;
+		root.leaf = FALSE;
+		root.n = 1;
+		root.keys[0] = up;
+		root.ptrs[0] = right;
+		writeNode(t, m.npages, &root, 0, 1, m.root);
+		m.root = m.npages++;
+		m.height++;
+		free(up);
+	}
+	if (added) m.nentries++;
+	writeMeta(t, &m);
+	unlockRange(t->f, 0, 0);
+}
+
+// add (key,val) to the subtree under node p
+// if p had to split, returns TRUE, with the first key of the
+//   new node to its right in *up (to be freed), and its page
+//   in *right
+
+static Bool insertUnder(BTree t, Meta *m, PageID p, char *key, Bits val,
+                        char **up, PageID *right, Bool *added)
+{
+	char buf[PAGESIZE];
+	Node nd;
+	readNode(t, p, &nd, buf);
+	Count i;
+	char *newKey;    // entry to add to this node, at i
+	PageID newPtr;
+	// after any equal keys
+	for (i = 0; i < nd.n && keyCompare(nd.keys[i], key) <= 0; i++) {
+		if (nd.leaf && nd.ptrs[i] == val && strcmp(nd.keys[i], key) == 0)
+			return FALSE;
+	}
+	if (nd.leaf) {
+		newKey = key;
+		newPtr = val;
+		*added = TRUE;
+	}
+	else {
+		PageID child = (i == 0) ? nd.link : nd.ptrs[i-1];
+		if (!insertUnder(t, m, child, key, val, &newKey, &newPtr, added))
+			return FALSE;
+	}
+	memmove(&nd.keys[i+1], &nd.keys[i], (nd.n-i)*sizeof(char *));
+	memmove(&nd.ptrs[i+1], &nd.ptrs[i], (nd.n-i)*sizeof(Bits));
+	nd.keys[i] = newKey;
+	nd.ptrs[i] = newPtr;
+	nd.n++;
+
+	Count total = nodeBytes(&nd, 0, nd.n);
+	if (total <= NODESPACE) {
+		writeNode(t, p, &nd, 0, nd.n, nd.link);
+		if (!nd.leaf) free(newKey);
+		return FALSE;
+	}
+
+	// split about half way (by bytes), keeping both halves non-empty
+	Count s = 1;
+	while (s < nd.n-1 && nodeBytes(&nd, 0, s) < total/2) s++;
+	PageID q = m->npages++;
+	*up = copyString(nd.keys[s]);
+	*right = q;
+	if (nd.leaf) {
+		writeNode(t, q, &nd, s, nd.n, nd.link);
+		writeNode(t, p, &nd, 0, s, q);
+	}
+	else {
+		// keys[s] moves up; its child starts the right node
+		writeNode(t, q, &nd, s+1, nd.n, nd.ptrs[s]);
+		writeNode(t, p, &nd, 0, s, nd.link);
+		free(newKey);
+	}
+	return TRUE;
+}
+
+// the values of keys from lo to hi (inclusive; NULL for no
+// limit), in key order, into *vals (to be freed)
+// stops after max+1 of them, so a result > max means "too many"
+// adds #pages read to *pages
+
+Count btreeRange(BTree t, char *lo, char *hi, Count max, Bits **vals, Count *pages)
+{
+	char buf[PAGESIZE];
+	Node nd;
+	Meta m;
+	Count n = 0, size = 64, i;
+	Bits *v = malloc(size*sizeof(Bits));
+	assert(v != NULL);
+	lockRange(t->f, 0, 0, LOCK_SHARED, TRUE);
+	readMeta(t, &m);
+	(*pages)++;
+	PageID p = m.root;
+	for (;;) {
+		readNode(t, p, &nd, buf);
+		(*pages)++;
+		if (nd.leaf) break;
+		// before any separator equal to lo
+		for (i = 0; i < nd.n && lo != NULL && keyCompare(nd.keys[i], lo) < 0; i++) ;
+		p = (i == 0) ? nd.link : nd.ptrs[i-1];
+	}
+	for (;;) {
+		for (i = 0; i < nd.n; i++) {
+			if (lo != NULL && keyCompare(nd.keys[i], lo) < 0) continue;
+			if (hi != NULL && keyCompare(nd.keys[i], hi) > 0) break;
+			if (n == size) {
+				size *= 2;
+				v = realloc(v, size*sizeof(Bits));
+				assert(v != NULL);
+			}
+			v[n++] = nd.ptrs[i];
+			if (n > max) break;
+		}
+		if (i < nd.n || nd.link == NO_PAGE) break;
+		readNode(t, nd.link, &nd, buf);
+		(*pages)++;
+	}
+	unlockRange(t->f, 0, 0);
+	*vals = v;
+	return n;
+}
+
+static void readMeta(BTree t, Meta *m)
+{
+	fseek(t->f, 0, SEEK_SET);
+	int n = fread(m, sizeof(Meta), 1, t->f);
+	assert(n == 1 && m->magic == BTMAGIC);
+}
+
+static void writeMeta(BTree t, Meta *m)
+{
+	char buf[PAGESIZE];
+	memset(buf, 0, PAGESIZE);
+	memcpy(buf, m, sizeof(Meta));
+	fseek(t->f, 0, SEEK_SET);
+	int n = fwrite(buf, PAGESIZE, 1, t->f);
+	assert(n == 1);
+}
+
+// read node p into buf, and unpack it into nd
+
+static void readNode(BTree t, PageID p, Node *nd, char *buf)
+{
+	fseek(t->f, (long)p*PAGESIZE, SEEK_SET);
+	int n = fread(buf, PAGESIZE, 1, t->f);
+	assert(n == 1);
+	memcpy(&nd->leaf, buf, sizeof(Count));
+	memcpy(&nd->n, buf+sizeof(Count), sizeof(Count));
+	memcpy(&nd->link, buf+2*sizeof(Count), sizeof(PageID));
+	char *e = buf + NODEHDR;
+	for (Count i = 0; i < nd->n; i++) {
+		memcpy(&nd->ptrs[i], e, sizeof(Bits));
+		nd->keys[i] = e + sizeof(Bits);
+		e = nd->keys[i] + strlen(nd->keys[i]) + 1;
+	}
+}
+
+// write entries from..to-1 of nd as node p, with the given link
+
+static void writeNode(BTree t, PageID p, Node *nd, Count from, Count to, PageID link)
+{
+	char buf[PAGESIZE];
+	Count n = to - from;
+	memset(buf, 0, PAGESIZE);
+	memcpy(buf, &nd->leaf, sizeof(Count));
+	memcpy(buf+sizeof(Count), &n, sizeof(Count));
+	memcpy(buf+2*sizeof(Count), &link, sizeof(PageID));
+	char *e = buf + NODEHDR;
+	for (Count i = from; i < to; i++) {
+		memcpy(e, &nd->ptrs[i], sizeof(Bits));
+		strcpy(e + sizeof(Bits), nd->keys[i]);
+		e += sizeof(Bits) + strlen(nd->keys[i]) + 1;
+	}
+	assert(e <= buf + PAGESIZE);
+	fseek(t->f, (long)p*PAGESIZE, SEEK_SET);
+	int ok = fwrite(buf, PAGESIZE, 1, t->f);
+	assert(ok == 1);
+}
+
+// bytes taken by entries from..to-1 of nd
+
+static Count nodeBytes(Node *nd, Count from, Count to)
+{
+	Count bytes = 0;
+	for (Count i = from; i < to; i++)
+		bytes += sizeof(Bits) + strlen(nd->keys[i]) + 1;
+	return bytes;
+}
@@ -0,0 +1,29 @@
+// btree.h ... interface to B+-tree indexes
+// part of Multi-attribute Linear-hashed Files
+// A BTree maps attribute values (keys) to Bits (e.g. the hashes
+//   of the tuples that have them), in a file of PAGESIZE nodes
+// The same key can have many values; adding a (key,value) pair
+//   that's already there usually does nothing
+// Keys are ordered as ints if they're ints, and before all
+//   keys that aren't, which are ordered as strings
+// See btree.c for details on functions
+
+#ifndef BTREE_H
+#define BTREE_H 1
+
+#include "defs.h"
+#include "bits.h"
+
+typedef struct BTreeRep *BTree;
+
+BTree newBTree(char *fname, Bits stamp);
+BTree openBTree(char *fname, char *mode);
+void closeBTree(BTree t);
+FILE *btreeFile(BTree t);
+Bits btreeStamp(BTree t);
+Count btreeSize(BTree t, Count *pages, Count *height);
+void btreeInsert(BTree t, char *key, Bits val);
+Count btreeRange(BTree t, char *lo, char *hi, Count max, Bits **vals, Count *pages);
+int keyCompare(char *a, char *b);
+
+#endif
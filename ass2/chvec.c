@@ -8,6 +8,7 @@
 #include "defs.h"
 #include "reln.h"
 #include "chvec.h"
+#include "bits.h"
 
 // convert a a,b:a,b:a,b:...:a,b" representation
 //  of a choice vector into a ChVec
@@ -46,13 +47,25 @@ Status parseChVec(Reln r, char *str, ChVec cv)
 	// get enough bits for a 32-bit choice vector
 	// take new bits from top end of each hash,
 	//   so as to hopefully not conflict 
-	Count x;  Count next[MAXCHVEC];
+	// except for order-preserving attributes, whose hashes are
+	//   bit-reversed places (see orderHash()): they take the
+	//   lowest bits not yet used, so a file uses the top bits of
+	//   the place, and a range of values falls in few buckets
+	Count x;  Count next[MAXCHVEC];  Bits used[MAXCHVEC] = {0};
+	OrderSpec *o = orderSpec(r);
+	for (x = 0; x < i; x++) used[cv[x].att] |= 1u << cv[x].bit;
 	for (x = 0; x < MAXCHVEC; x++) next[x] = 31;
+	for (x = 0; x < nattr; x++)
+		if (bitAt(o->attrs, x)) next[x] = 0;
 	x = 0;
 	while (i < MAXCHVEC) {
+		if (bitAt(o->attrs, x))
+			while (next[x] < 31 && bitAt(used[x], next[x])) next[x]++;
 		cv[i].att = x; cv[i].bit = next[x];
 		printf("cv[%d] is (%d,%d)\n", i, cv[i].att, cv[i].bit);
-		next[x]--;
+		used[x] |= 1u << next[x];
+		if (!bitAt(o->attrs, x)) next[x]--;
+		else if (next[x] < 31) next[x]++;
 		i++; x = (x+1) % nattr;
 	}
 	return OK;
@@ -69,3 +82,96 @@ void printChVec(ChVec cv)
 	}
 	printf("\n");
 }
+
+// compile a choice vector into per-attribute gather plans
+// done once when the relation is opened
+
+void compileChVec(ChVec cv, Count nattrs, ChVecPlan *plan)
+{
+	int i, a, k, v;
+	memset(plan, 0, sizeof(ChVecPlan));
+	for (a = 0; a < nattrs; a++) plan->monotone[a] = TRUE;
+	int last[MAXATTRS];  // src bit of previous item for each attr
+	for (a = 0; a < nattrs; a++) last[a] = -1;
+	for (i = 0; i < MAXCHVEC; i++) {
+		a = cv[i].att;
+		Bits bit = 1u << cv[i].bit;
+		// PEXT packs src bits in ascending order, so the mapping
+		//  only works if each attr's bits increase along the vector
+		if (cv[i].bit <= last[a] || (plan->src[a] & bit) != 0)
+			plan->monotone[a] = FALSE;
+		last[a] = cv[i].bit;
+		plan->src[a] |= bit;
+		plan->dst[a] |= 1u << i;
+	}
+	for (a = 0; a < nattrs; a++) {
+		if (plan->dst[a] == 0) continue;
+		plan->tab[a] = calloc(4, sizeof(Bits [256]));
+		assert(plan->tab[a] != NULL);
+		for (i = 0; i < MAXCHVEC; i++) {
+			if (cv[i].att != a) continue;
+			k = cv[i].bit / 8;
+			Bits bit = 1u << (cv[i].bit % 8);
+			for (v = 0; v < 256; v++) {
+				if (v & bit) plan->tab[a][k][v] |= 1u << i;
+			}
+		}
+	}
+}
+
+void freeChVecPlan(ChVecPlan *plan)
+{
+	for (int a = 0; a < MAXATTRS; a++) {
+		free(plan->tab[a]);
+		plan->tab[a] = NULL;
+	}
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+
+__attribute__((target("bmi2")))
+static Bits gatherBMI2(Bits h, Bits src, Bits dst)
+{
+	return _pdep_u32(_pext_u32(h, src), dst);
+}
+
+static int hasBMI2 = -1;  // unknown until first call
+#endif
+
+// build a combined hash from per-attribute hashes
+// attrs is a bit-set of which attributes to include
+//  (unknown attributes in a query are left out)
+
+Bits chvecGather(ChVecPlan *plan, Bits *hashes, Bits attrs)
+{
+	Bits h = 0;
+#if defined(__x86_64__) && defined(__GNUC__)
+	if (hasBMI2 < 0) hasBMI2 = __builtin_cpu_supports("bmi2");
+#endif
+	for (int a = 0; attrs != 0; a++, attrs >>= 1) {
+		if (!(attrs & 1) || plan->dst[a] == 0) continue;
+		Bits v = hashes[a];
+#if defined(__x86_64__) && defined(__GNUC__)
+		if (hasBMI2 && plan->monotone[a]) {
+			h |= gatherBMI2(v, plan->src[a], plan->dst[a]);
+			continue;
+		}
+#endif
+		Bits (*t)[256] = plan->tab[a];
+		h |= t[0][v & 0xff] | t[1][(v >> 8) & 0xff]
+		   | t[2][(v >> 16) & 0xff] | t[3][v >> 24];
+	}
+	return h;
+}
+
+// which bits of the combined hash come from the given attributes
+
+Bits chvecPositions(ChVecPlan *plan, Bits attrs)
+{
+	Bits pos = 0;
+	for (int a = 0; attrs != 0; a++, attrs >>= 1) {
+		if (attrs & 1) pos |= plan->dst[a];
+	}
+	return pos;
+}
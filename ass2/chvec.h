@@ -10,6 +10,7 @@
 
 #include "defs.h"
 #include "reln.h"
+#include "bits.h"
 
 #define MAXCHVEC 32
 
@@ -17,7 +18,26 @@ typedef struct _ChVecItem { Byte att; Byte bit; } ChVecItem;
 
 typedef ChVecItem ChVec[MAXCHVEC];
 
+// A ChVecPlan is a choice vector compiled for gathering bits
+// For each attribute a, src[a] is the set of bits taken from
+//  the attribute's hash and dst[a] is where they go in the
+//  combined hash; tab[a][k][v] is the contribution of byte k
+//  of the attribute's hash having value v
+// If the (src bit -> dst bit) mapping is increasing, a PEXT/PDEP
+//  pair does the same job on CPUs that have BMI2
+
+typedef struct _ChVecPlan {
+	Bits src[MAXATTRS];
+	Bits dst[MAXATTRS];
+	Bool monotone[MAXATTRS];
+	Bits (*tab[MAXATTRS])[256];
+} ChVecPlan;
+
 Status parseChVec(Reln r, char *str, ChVec cv);
 void printChVec(ChVec cv);
+void compileChVec(ChVec cv, Count nattrs, ChVecPlan *plan);
+void freeChVecPlan(ChVecPlan *plan);
+Bits chvecGather(ChVecPlan *plan, Bits *hashes, Bits attrs);
+Bits chvecPositions(ChVecPlan *plan, Bits attrs);
 
 #endif
@@ -0,0 +1,48 @@
+// compact.c ... squeeze deleted tuples out of a relation
+// part of Multi-attribute linear-hashed files
+// Repack each bucket's live tuples into as few pages of its
+//   chain as possible; emptied overflow pages go on the free list
+// Then merges buckets while the file is under a quarter full,
+//   but never below the #pages it was created with
+// Usage:  ./compact  RelName
+
+#include "defs.h"
+#include "reln.h"
+
+#define USAGE "./compact  RelName"
+
+// Main ... process args, compact each bucket
+
+int main(int argc, char **argv)
+{
+	char err[MAXERRMSG];  // buffer for error messages
+
+	// process command-line args
+
+	if (argc < 2) fatal(USAGE);
+	char *rname = argv[1];
+
+	if (!existsRelation(rname)) {
+		sprintf(err, "No such relation: %s",rname);
+		fatal(err);
+	}
+	Reln r = openRelation(rname,"r+");
+	if (r == NULL) {
+		sprintf(err, "Can't open relation: %s",rname);
+		fatal(err);
+	}
+
+	// buckets are latched one at a time, so inserts and scans
+	//   carry on; any buckets split off meanwhile are done too
+
+	Count nfreed = 0;
+	for (PageID p = 0; p < npages(r); p++) {
+		nfreed += compactBucket(r, p);
+	}
+	printf("Freed %d overflow pages\n", nfreed);
+	printf("Merged %d buckets\n", shrinkRelation(r));
+
+	closeRelation(r);
+
+	return 0;
+}
@@ -1,18 +1,50 @@
 // create.c ... create an empty Relation
 // part of Multi-attribute linear-hashed files
 // Ask a query on a named file
-// Usage:  ./create  [-v]  RelName  #attrs  #pages  ChoiceVector
+// Usage:  ./create  [-v]  [-h HashFn]  [--expect-tuples N  [--avg-tuple-bytes B]]
+//                  [--key a1,a2,...]  [--ordered a:lo:hi ...]  [--signatures W:K]
+//                  RelName  #attrs  #pages  ChoiceVector
 // where #attrs = # of attributes in each tuple
 //	   #pages = initial (empty) pages in File
 //	   ChoiceVector = attr,bit:attr,bit:...
+//	   HashFn = jenkins (default), crc32c or mix64
+//	   N = #tuples the file will hold; enough pages are made up
+//	       front (more than #pages, if needed) for N tuples of B
+//	       bytes (default 10 per attribute), and the file doesn't
+//	       split until it holds N tuples
+//	   a1,a2,... = attributes (from 0) that form a unique key;
+//	       inserts of tuples whose key is already there fail
+//	       (each insert reads the buckets a query on the key
+//	       would, so it's cheapest when the choice vector takes
+//	       its first bits from the key)
+//	   a:lo:hi = attribute a holds ints from lo to hi, and its
+//	       bits in the choice vector come from where its value
+//	       falls in that range (its first bit says which half,
+//	       and so on), not from hashing it, so select can find
+//	       a range of its values (lo..hi) in just the buckets
+//	       that cover it; can be given for several attributes
+//	       (values should spread evenly over the range, or the
+//	       buckets won't be even)
+//	   W:K = keep a signature of W bits (a multiple of 256, up
+//	       to 4096) for each bucket, in which each value of each
+//	       of its tuples sets K bits; select can then scan them
+//	       to find the buckets that may hold values its choice
+//	       vector bits don't narrow down (wider signatures, with
+//	       about W/(K*#values per bucket) to spare, give fewer
+//	       false matches)
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include "util.h"
 #include "reln.h"
+#include "hash.h"
+#include "sig.h"
 
-#define USAGE "./create  [-v]  RelName  #attrs  #pages  ChoiceVector"
+#define USAGE "./create  [-v]  [-h HashFn]  [--expect-tuples N  [--avg-tuple-bytes B]]  [--key a1,a2,...]  [--ordered a:lo:hi ...]  [--signatures W:K]  RelName  #attrs  #pages  ChoiceVector"
+
+// how full (%) to make the primary pages of a presized file
+#define TARGETLOAD 75
 
 
 // Main ... process args, create relation
@@ -28,26 +60,92 @@ int main(int argc, char **argv)
 	char *attrs;   // number of attributes in tuples
 	char *pages;   // number of pages in data file
 	char *cv;	  // choice vector
+	int hf;      // hash function (HASH_* value)
+	int expect;  // #tuples to presize for (0 if not presizing)
+	int avgbytes; // average tuple length when presizing
+	char *keys;  // attributes in the key (NULL if none)
+	OrderSpec order;  // order-preserving attributes
+	int sigwidth, sigk;  // signature bits, and bits per value (0 if none)
 
 	// Process command-line args
 
 	if (argc < 2) fatal(USAGE);
-	if (strcmp(argv[1], "-v") == 0) {
-		if (argc < 6) fatal(USAGE);
-	    verbose = 1; rname = argv[2]; attrs = argv[3]; pages = argv[4]; cv = argv[5];
-	}
-	else {
-		if (argc < 5) fatal(USAGE);
-	    verbose = 0; rname = argv[1]; attrs = argv[2]; pages = argv[3]; cv = argv[4];
+	int arg = 1;
+	verbose = 0; hf = HASH_JENKINS; expect = 0; avgbytes = 0; keys = NULL;
+	sigwidth = sigk = 0;
+	memset(&order, 0, sizeof(OrderSpec));
+	while (arg < argc && argv[arg][0] == '-') {
+		if (strcmp(argv[arg], "-v") == 0)
+			verbose = 1;
+		else if (strcmp(argv[arg], "-h") == 0 && arg+1 < argc) {
+			arg++;
+			if ((hf = hashByName(argv[arg])) < 0) {
+				sprintf(err, "Invalid hash function: %.50s", argv[arg]);
+				fatal(err);
+			}
+		}
+		else if (strcmp(argv[arg], "--expect-tuples") == 0 && arg+1 < argc) {
+			expect = atoi(argv[++arg]);
+			if (expect < 1) fatal(USAGE);
+		}
+		else if (strcmp(argv[arg], "--avg-tuple-bytes") == 0 && arg+1 < argc) {
+			avgbytes = atoi(argv[++arg]);
+			if (avgbytes < 1 || avgbytes >= MAXTUPLEN) fatal(USAGE);
+		}
+		else if (strcmp(argv[arg], "--key") == 0 && arg+1 < argc)
+			keys = argv[++arg];
+		else if (strcmp(argv[arg], "--ordered") == 0 && arg+1 < argc) {
+			int a, lo, hi;
+			char junk;
+			arg++;
+			if (sscanf(argv[arg], "%d:%d:%d%c", &a, &lo, &hi, &junk) != 3
+			    || a < 0 || a >= MAXATTRS || lo > hi) {
+				sprintf(err, "Invalid ordered attribute: %.50s", argv[arg]);
+				fatal(err);
+			}
+			order.attrs |= 1u << a;
+			order.lo[a] = lo;  order.hi[a] = hi;
+		}
+		else if (strcmp(argv[arg], "--signatures") == 0 && arg+1 < argc) {
+			char junk;
+			arg++;
+			if (sscanf(argv[arg], "%d:%d%c", &sigwidth, &sigk, &junk) != 2
+			    || sigwidth < 1 || sigk < 1 || !sigValid(sigwidth, sigk)) {
+				sprintf(err, "Invalid signatures: %.50s (width a multiple of 256, up to %d)",
+				        argv[arg], MAXSIGWIDTH);
+				fatal(err);
+			}
+		}
+		else
+			fatal(USAGE);
+		arg++;
 	}
+	if (argc - arg < 4) fatal(USAGE);
+	rname = argv[arg]; attrs = argv[arg+1]; pages = argv[arg+2]; cv = argv[arg+3];
 
 	// how many attributes in each tuple
 	nattrs = atoi(attrs);
-	if (nattrs < 2 || nattrs > 10) {
+	if (nattrs < 2 || nattrs > MAXATTRS) {
 		sprintf(err, "Invalid #attrs: %d (must be 1 < # < 11)", nattrs);
 		fatal(err);
 	}
 
+	// which attributes are in the key
+	Bits key = 0;
+	for (char *a = (keys == NULL) ? NULL : strtok(keys, ","); a != NULL; a = strtok(NULL, ",")) {
+		int i = atoi(a);
+		if (i < 0 || i >= nattrs) {
+			sprintf(err, "Invalid key attribute: %.50s", a);
+			fatal(err);
+		}
+		key |= 1u << i;
+	}
+	if (keys != NULL && key == 0) fatal(USAGE);
+	if (order.attrs >= (1u << nattrs)) {
+		sprintf(err, "Invalid ordered attribute (must be < %d)", nattrs);
+		fatal(err);
+	}
+
 	// how many initally empty pages
 	npages = atoi(pages);
 	if (npages < 1 || npages > 64) {
@@ -56,11 +154,27 @@ int main(int argc, char **argv)
 	}
 	// convert to least 2^d >= npages
 	// d gives initial depth of file
-	int d = 0, np = 1;
+	int d = 0, np = 1, sp = 0;
 	while (np < npages) { d++; np <<= 1; }
 
+	// presize: enough buckets for expect tuples at TARGETLOAD,
+	// laid out as 2^d buckets with the first sp already split
+	if (expect > 0) {
+		if (avgbytes == 0) avgbytes = 10*nattrs;
+		Count hdr_size = 2*sizeof(Offset) + sizeof(Count);
+		int perPage = (PAGESIZE - hdr_size) / (avgbytes + 1);
+		int perBucket = perPage * TARGETLOAD / 100;
+		if (perBucket < 1) perBucket = 1;
+		int need = (expect + perBucket - 1) / perBucket;
+		if (need > np) {
+			for (d = 0; (2 << d) <= need; d++) ;
+			sp = need - (1 << d);
+			np = need;
+		}
+	}
+
 	if (verbose)
-		printf("#a=%d, #p=%d, d=%d\n", nattrs, np, d);
+		printf("#a=%d, #p=%d, d=%d, sp=%d, hash=%s\n", nattrs, np, d, sp, hashName(hf));
 
 	// Open files for the Relation and initialise
 
@@ -68,9 +182,19 @@ int main(int argc, char **argv)
 		sprintf(err, "Relation %s already exists", rname);
 		fatal(err);
 	}
-	if (newRelation(rname, nattrs, np, d, cv) != OK) {
+	if (newRelation(rname, nattrs, np, d, sp, cv, hf, expect, key, &order) != OK) {
 		sprintf(err, "Problems while creating relation %s", rname);
 		fatal(err);
 	}
+	if (sigwidth > 0) {
+		Reln r = openRelation(rname, "r+");
+		latchSplit(r, LOCK_EXCL);
+		if (addSignatures(r, sigwidth, sigk) != OK) {
+			sprintf(err, "Problems while adding signatures to %s", rname);
+			fatal(err);
+		}
+		unlatchSplit(r);
+		closeRelation(r);
+	}
 	return OK;
 }
@@ -19,6 +19,7 @@
 #define MAXRELNAME  200
 #define MAXFILENAME MAXRELNAME+8
 #define MAXBITS     32
+#define MAXATTRS    10
 #define OK          0
 #define TRUE        1
 #define FALSE       0
@@ -0,0 +1,84 @@
+// delete.c ... delete tuples from a relation
+// part of Multi-attribute linear-hashed files
+// Delete all tuples matching a partial-match query
+// Usage:  ./delete  [-v]  RelName  v1,v2,v3,v4,...
+// where any of the vi's can be "?" (unknown), or a list of values
+//   separated by "|" (e.g. "a|b|c") any of which matches, or a
+//   range of ints "lo..hi" (either end can be left out), which
+//   only reads some of the buckets if the attribute is ordered
+//   (see create)
+// -v shows each tuple as it's deleted
+// Afterwards, merges buckets if the file is under a quarter full,
+//   but never below the #pages it was created with
+
+#include "defs.h"
+#include "query.h"
+#include "tuple.h"
+#include "reln.h"
+
+#define USAGE "./delete  [-v]  RelName  v1,v2,v3,v4,..."
+
+// Main ... process args, delete matching tuples
+
+int main(int argc, char **argv)
+{
+	Reln r;  // handle on the open relation
+	Query q;  // processed version of query string
+	Tuple t;  // tuple pointer
+	char err[MAXERRMSG];  // buffer for error messages
+	int verbose;  // show each deleted tuple
+	char *rname;  // name of table/file
+	char *qstr;   // query string
+
+	// process command-line args
+
+	if (argc < 3) fatal(USAGE);
+	if (strcmp(argv[1], "-v") == 0) {
+		if (argc < 4) fatal(USAGE);
+		verbose = 1;  rname = argv[2];  qstr = argv[3];
+	}
+	else {
+		verbose = 0;  rname = argv[1];  qstr = argv[2];
+	}
+
+	// initialise relation and scanning structure
+
+	if (!existsRelation(rname)) {
+		sprintf(err, "No such relation: %s",rname);
+		fatal(err);
+	}
+	if ((r = openRelation(rname,"r+")) == NULL) {
+		sprintf(err, "Can't open relation: %s",rname);
+		fatal(err);
+	}
+	if ((q = startUpdate(r, qstr)) == NULL) {
+		sprintf(err, "Invalid query: %s",qstr);
+		fatal(err);
+	}
+
+	// mark each matching tuple as deleted
+
+	Count ndeleted = 0;
+	char tup[MAXTUPLEN];
+	while ((t = getNextTuple(q)) != NULL) {
+		deleteCurrentTuple(q);
+		ndeleted++;
+		if (verbose) {
+			tupleString(t,tup);
+			printf("%s\n",tup);
+		}
+		free(t);
+	}
+	printf("Deleted %d tuples\n", ndeleted);
+	closeQuery(q);
+
+	// give back buckets if the file is now mostly empty
+	Count nmerged = shrinkRelation(r);
+	if (nmerged > 0) printf("Merged %d buckets\n", nmerged);
+
+	// clean up
+
+	closeRelation(r);
+
+	return 0;
+}
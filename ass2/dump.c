@@ -29,22 +29,19 @@ int main(int argc, char **argv)
 	if (r == NULL)
 		fatal("Can't open relation");
 
+	// everything in each bucket as of when r was opened,
+	//   without holding up any splits
 	for (Offset pid = 0; pid < npages(r); pid++) {
 		printf("Bucket[%d]\n",pid);
-		// show tuples in data file
-		Page pg = getPage(dataFile(r),pid);
-		showAllTuples(pg);
-		// show tuples in overflow pages
-		Page ovpg;  PageID ovp;
-		ovp = pageOvflow(pg);
-		while (ovp != NO_PAGE) {
-			printf("Ovflow->\n");
-			ovpg = getPage(ovflowFile(r), ovp);
-			showAllTuples(ovpg);
-			ovp = pageOvflow(ovpg);
-			free(ovpg);
+		Page *pgs;
+		Count n = readBucket(r, pid, bucketDepth(r,pid), &pgs);
+		for (Count i = 0; i < n; i++) {
+			// show tuples in data page, then overflow pages
+			if (i > 0) printf("Ovflow->\n");
+			showAllTuples(pgs[i]);
+			free(pgs[i]);
 		}
-		free(pg);
+		free(pgs);
 	}
 	closeRelation(r);
 
@@ -58,7 +55,7 @@ void showAllTuples(Page pg)
 		Count ntups = pageNTuples(pg);
 		char *c = pageData(pg);
 		for (int i = 0; i < ntups; i++) {
-			printf("%s\n", c);
+			if (c[0] != TOMBSTONE) printf("%s\n", c);
 			c += strlen(c) + 1;
 		}
 }
@@ -0,0 +1,55 @@
+// grow.c ... split many buckets of a relation at once
+// part of Multi-attribute linear-hashed files
+// Grows the file to #pages buckets in one sequential pass per
+//   doubling, e.g. after a bulk load, or for a lower load factor
+// It won't then split again until it holds as many tuples as
+//   #pages buckets would have split at, nor merge back below
+// Usage:  ./grow  [-v]  RelName  #pages
+// -v shows the new depth and split pointer
+
+#include "defs.h"
+#include "reln.h"
+
+#define USAGE "./grow  [-v]  RelName  #pages"
+
+// Main ... process args, grow relation
+
+int main(int argc, char **argv)
+{
+	char err[MAXERRMSG];  // buffer for error messages
+	int verbose;  // show new depth and sp
+	char *rname;  // name of table/file
+	int target;   // #buckets wanted
+
+	// process command-line args
+
+	if (argc < 3) fatal(USAGE);
+	if (strcmp(argv[1], "-v") == 0) {
+		if (argc < 4) fatal(USAGE);
+		verbose = 1;  rname = argv[2];  target = atoi(argv[3]);
+	}
+	else {
+		verbose = 0;  rname = argv[1];  target = atoi(argv[2]);
+	}
+	if (target < 1) fatal(USAGE);
+
+	if (!existsRelation(rname)) {
+		sprintf(err, "No such relation: %s",rname);
+		fatal(err);
+	}
+	Reln r = openRelation(rname,"r+");
+	if (r == NULL) {
+		sprintf(err, "Can't open relation: %s",rname);
+		fatal(err);
+	}
+
+	// inserts wait until it's done; scans wait while buckets move
+
+	printf("Added %d buckets\n", growRelation(r, target));
+	if (verbose)
+		printf("#pages:%d  d:%d  sp:%d\n", npages(r), depth(r), splitp(r));
+
+	closeRelation(r);
+
+	return 0;
+}
@@ -1,4 +1,4 @@
-// hash.c ... hash function (from PostgreSQL)
+// hash.c ... hash functions (hash_any from PostgreSQL)
 // part of Multi-attribute Linear-hashed Files
 // Last modified by John Shepherd, July 2019
 
@@ -95,3 +95,293 @@ hash_any(unsigned char *k, int keylen)
 	final(a, b, c);
 	return c;
 }
+
+// final avalanche step from MurmurHash3
+// spreads the (linear) CRC bits over the whole word
+// also used to get independent-looking bits from a value's hash
+//   for sketches and Bloom filters, whose bits the choice vector
+//   may already have used
+
+Bits fmix32(Bits h)
+{
+	h ^= h >> 16;  h *= 0x85ebca6b;
+	h ^= h >> 13;  h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+// software CRC32C (Castagnoli polynomial, reflected)
+// table is built on first use
+
+static Bits crcTable[256];
+static int crcTableReady = 0;
+
+static void crcMakeTable()
+{
+	for (Bits i = 0; i < 256; i++) {
+		Bits c = i;
+		for (int j = 0; j < 8; j++)
+			c = (c & 1) ? (c >> 1) ^ 0x82f63b78 : (c >> 1);
+		crcTable[i] = c;
+	}
+	crcTableReady = 1;
+}
+
+static Bits crc32cSoft(unsigned char *k, int keylen)
+{
+	if (!crcTableReady) crcMakeTable();
+	Bits c = 0xffffffff;
+	while (keylen-- > 0)
+		c = crcTable[(c ^ *k++) & 0xff] ^ (c >> 8);
+	return ~c;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+
+// hardware CRC32C, 8 bytes per crc32 instruction
+// compiled for SSE4.2 regardless of -march; only
+//   called once the CPU is known to support it
+
+__attribute__((target("sse4.2")))
+static Bits crc32cHard(unsigned char *k, int keylen)
+{
+	unsigned long long c = 0xffffffff, w;
+	while (keylen >= 8) {
+		memcpy(&w, k, 8);
+		c = _mm_crc32_u64(c, w);
+		k += 8;  keylen -= 8;
+	}
+	Bits c32 = (Bits)c;
+	while (keylen-- > 0)
+		c32 = _mm_crc32_u8(c32, *k++);
+	return ~c32;
+}
+
+static int hasSSE42 = -1;  // unknown until first call
+#endif
+
+// the raw CRC32C by each path, so they can be checked against
+//   each other; crc32cSSE42() returns FALSE if the CPU lacks SSE4.2
+
+Bits crc32cTable(unsigned char *k, int keylen)
+{
+	return crc32cSoft(k, keylen);
+}
+
+Bool crc32cSSE42(unsigned char *k, int keylen, Bits *crc)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+	if (hasSSE42 < 0) hasSSE42 = __builtin_cpu_supports("sse4.2");
+	if (hasSSE42) {
+		*crc = crc32cHard(k, keylen);
+		return TRUE;
+	}
+#endif
+	return FALSE;
+}
+
+Bits
+hash_crc32c(unsigned char *k, int keylen)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+	if (hasSSE42 < 0) hasSSE42 = __builtin_cpu_supports("sse4.2");
+	if (hasSSE42) return fmix32(crc32cHard(k, keylen));
+#endif
+	return fmix32(crc32cSoft(k, keylen));
+}
+
+// 64-bit hash in the style of wyhash/xxh3:
+// one multiply and rotate per 8-byte word, 64-bit finaliser,
+//   then the two halves are folded into the 32-bit result
+
+#define M64A 0x9e3779b97f4a7c15ULL
+#define M64B 0xbf58476d1ce4e5b9ULL
+#define M64C 0x94d049bb133111ebULL
+#define rot64(x,k) (((x)<<(k)) | ((x)>>(64-(k))))
+
+Bits
+hash_mix64(unsigned char *k, int keylen)
+{
+	unsigned long long h = M64A ^ ((unsigned long long)keylen * M64B), w;
+	while (keylen >= 8) {
+		memcpy(&w, k, 8);
+		h ^= w * M64B;
+		h = rot64(h, 31) * M64A;
+		k += 8;  keylen -= 8;
+	}
+	if (keylen > 0) {
+		// remaining 1..7 bytes, little-endian, tagged with their count
+		w = 0;
+		memcpy(&w, k, keylen);
+		h ^= (w ^ ((unsigned long long)keylen << 56)) * M64B;
+		h = rot64(h, 31) * M64A;
+	}
+	h ^= h >> 30;  h *= M64B;
+	h ^= h >> 27;  h *= M64C;
+	h ^= h >> 31;
+	return (Bits)(h ^ (h >> 32));
+}
+
+// is val an int (all of it)? and which
+// (e.g. "42", "-7", but not "", "4x" or "1e3")
+
+Bool intValue(char *val, long long *v)
+{
+	char *end;
+	if (*val == '\0') return FALSE;
+	*v = strtoll(val, &end, 10);
+	return *end == '\0';
+}
+
+// an order-preserving attribute has int values in lo..hi, and
+// its "hash" comes from the value's place in that range: a
+// 32-bit fraction of the way from lo to hi, so it increases
+// with the value; values outside the range count as the nearer
+// end of it (and those that aren't ints as lo)
+
+Bits orderPlace(long long v, int lo, int hi)
+{
+	if (v < lo) v = lo;
+	if (v > hi) v = hi;
+	return (Bits)(((unsigned long long)(v - lo) << 32) / ((long long)hi - lo + 1));
+}
+
+// the place, bit-reversed, as the choice vector takes an
+// attribute's bits from bit 0 up: the bits a file uses are
+// then the top bits of the place, so a range of values
+// falls in a run of settings of them (see query.c)
+
+Bits orderHash(char *val, int lo, int hi)
+{
+	long long v;
+	if (!intValue(val, &v)) v = lo;
+	return reverseBits(orderPlace(v, lo, hi));
+}
+
+// table of hash functions, indexed by HASH_* value
+
+static struct { char *name; HashFn fn; } hashFns[NHASHFNS] = {
+	{ "jenkins", hash_any },
+	{ "crc32c",  hash_crc32c },
+	{ "mix64",   hash_mix64 },
+};
+
+HashFn hashFunction(int which)
+{
+	assert(0 <= which && which < NHASHFNS);
+	return hashFns[which].fn;
+}
+
+char *hashName(int which)
+{
+	if (which < 0 || which >= NHASHFNS) return "?";
+	return hashFns[which].name;
+}
+
+// map a name (as given to create) to a HASH_* value
+// returns -1 if there's no such hash function
+
+int hashByName(char *name)
+{
+	for (int i = 0; i < NHASHFNS; i++) {
+		if (strcmp(name, hashFns[i].name) == 0) return i;
+	}
+	return -1;
+}
+
+// HashMemo: open-addressing table from value bytes to hash
+// - values longer than MEMOKEYLEN aren't memoised
+// - the table never grows; once it's 3/4 full, new values
+//   are hashed but not remembered, and if by then most lookups
+//   have missed, the values are too varied to be worth it, so
+//   later lookups skip the table and just call the hash function
+// - a lookup probes at most MEMOPROBES slots, so a value that
+//   isn't in the table costs a few compares, not a walk of a
+//   cluster; a value with no empty slot within reach isn't
+//   remembered
+// - the slot mixes the length and each 4-byte word of the value,
+//   which is far cheaper than the real hash but spreads values
+//   that share a prefix and suffix
+
+#define MEMOSLOTS  4096
+#define MEMOFULL   (MEMOSLOTS/4*3)
+#define MEMOPROBES 8
+#define MEMOKEYLEN 27
+
+typedef struct {
+	Bits hash;
+	Byte len;      // 0 means empty slot
+	char key[MEMOKEYLEN];
+} MemoSlot;
+
+struct HashMemoRep {
+	HashFn fn;     // hash function being memoised
+	Count  nused;  // #slots holding values
+	Count  hits;   // #lookups answered from the table
+	Count  misses; // #lookups that called fn
+	MemoSlot slot[MEMOSLOTS];
+};
+
+HashMemo newHashMemo(HashFn fn)
+{
+	HashMemo m = calloc(1, sizeof(struct HashMemoRep));
+	assert(m != NULL);
+	m->fn = fn;
+	return m;
+}
+
+void freeHashMemo(HashMemo m)
+{
+	free(m);
+}
+
+static Bits memoSlot(unsigned char *k, int keylen)
+{
+	Bits s = keylen * 0xc2b2ae35, w;
+	while (keylen >= 4) {
+		memcpy(&w, k, 4);
+		s = (s ^ w) * 0x9e3779b1;
+		s ^= s >> 15;
+		k += 4;  keylen -= 4;
+	}
+	if (keylen > 0) {
+		w = 0;
+		memcpy(&w, k, keylen);
+		s = (s ^ w) * 0x85ebca6b;
+	}
+	return (s ^ (s >> 15)) & (MEMOSLOTS-1);
+}
+
+Bits memoHash(HashMemo m, unsigned char *k, int keylen)
+{
+	if (keylen == 0 || keylen > MEMOKEYLEN
+	    || (m->nused >= MEMOFULL && m->hits < m->misses)) {
+		m->misses++;
+		return m->fn(k, keylen);
+	}
+	Bits i = memoSlot(k, keylen);
+	int p;
+	for (p = 0; p < MEMOPROBES && m->slot[i].len != 0; p++) {
+		if (m->slot[i].len == keylen && memcmp(m->slot[i].key, k, keylen) == 0) {
+			m->hits++;
+			return m->slot[i].hash;
+		}
+		i = (i + 1) & (MEMOSLOTS-1);
+	}
+	m->misses++;
+	Bits h = m->fn(k, keylen);
+	if (p < MEMOPROBES && m->nused < MEMOFULL) {
+		m->slot[i].hash = h;
+		m->slot[i].len = keylen;
+		memcpy(m->slot[i].key, k, keylen);
+		m->nused++;
+	}
+	return h;
+}
+
+void memoStats(HashMemo m, Count *hits, Count *misses)
+{
+	*hits = m->hits;
+	*misses = m->misses;
+}
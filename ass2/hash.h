@@ -1,13 +1,47 @@
-// hash.h ... interface to hash function
+// hash.h ... interface to hash functions
 // part of Multi-attribute Linear-hashed Files
-// Hash function from PostgreSQL
+// Hash function from PostgreSQL, plus alternatives
+//   selectable per relation at create time
 // Last modified by John Shepherd, July 2019
 
 #ifndef HASH_H
 #define HASH_H 1
 
+#include "defs.h"
 #include "bits.h"
 
+typedef Bits (*HashFn)(unsigned char *, int);
+
+// A HashMemo remembers the hashes of recently seen values
+// Useful when attribute values repeat a lot (e.g. gendata's words)
+typedef struct HashMemoRep *HashMemo;
+
+// hash function choices, as recorded in R.info
+#define HASH_JENKINS 0  // PostgreSQL's hash_any (the default)
+#define HASH_CRC32C  1  // CRC32C (SSE4.2 crc32 if the CPU has it)
+#define HASH_MIX64   2  // 64-bit multiply/xor mix, folded to 32 bits
+#define NHASHFNS     3
+
 Bits hash_any(unsigned char *, int);
+Bits hash_crc32c(unsigned char *, int);
+Bits hash_mix64(unsigned char *, int);
+Bits crc32cTable(unsigned char *, int);
+Bool crc32cSSE42(unsigned char *, int, Bits *);
+
+Bits fmix32(Bits h);
+
+// order-preserving "hash" of an int attribute in lo..hi
+Bool intValue(char *val, long long *v);
+Bits orderPlace(long long v, int lo, int hi);
+Bits orderHash(char *val, int lo, int hi);
+
+HashFn hashFunction(int which);
+char *hashName(int which);
+int hashByName(char *name);
+
+HashMemo newHashMemo(HashFn fn);
+void freeHashMemo(HashMemo m);
+Bits memoHash(HashMemo m, unsigned char *k, int keylen);
+void memoStats(HashMemo m, Count *hits, Count *misses);
 
 #endif
@@ -0,0 +1,65 @@
+// index.c ... build or drop a secondary index on an attribute
+// part of Multi-attribute linear-hashed files
+// Builds a B+-tree index, RelName.idx.Attr, on one attribute, from
+//   each value to where the tuples that have it are; after that,
+//   inserts keep it up to date, and select uses it for queries
+//   on the attribute when it reads fewer pages than the choice
+//   vector would (e.g. for attributes with few bits in it)
+// Running it again rebuilds the index (e.g. after rechvec)
+// Usage:  ./index  [--drop]  RelName  Attr
+// where Attr = attribute number (from 0)
+// --drop removes the index instead
+
+#include "defs.h"
+#include "reln.h"
+
+#define USAGE "./index  [--drop]  RelName  Attr"
+
+// Main ... process args, build or drop the index
+
+int main(int argc, char **argv)
+{
+	char err[MAXERRMSG];  // buffer for error messages
+	int drop;     // drop the index instead of building it
+	char *rname;  // name of table/file
+
+	// process command-line args
+
+	if (argc < 3) fatal(USAGE);
+	drop = strcmp(argv[1], "--drop") == 0;
+	if (argc < 3 + drop) fatal(USAGE);
+	rname = argv[1+drop];
+	int a = atoi(argv[2+drop]);
+
+	if (!existsRelation(rname)) {
+		sprintf(err, "No such relation: %s",rname);
+		fatal(err);
+	}
+	Reln r = openRelation(rname,"r+");
+	if (r == NULL) {
+		sprintf(err, "Can't open relation: %s",rname);
+		fatal(err);
+	}
+	if (a < 0 || a >= nattrs(r)) {
+		sprintf(err, "Invalid attribute: %.50s", argv[2+drop]);
+		fatal(err);
+	}
+
+	// no inserts while the index is built; scans carry on
+
+	latchSplit(r, LOCK_EXCL);
+	if (drop)
+		dropIndex(r, a);
+	else
+		buildIndex(r, a);
+	unlatchSplit(r);
+	if (!drop) {
+		Count pages, height;
+		Count n = btreeSize(attrIndex(r, a), &pages, &height);
+		printf("Indexed %d values of attribute %d (%d pages, height %d)\n",
+		       n, a, pages, height);
+	}
+	closeRelation(r);
+
+	return 0;
+}
@@ -1,14 +1,42 @@
 // insert.c ... add tuples to a relation
 // part of Multi-attribute linear-hashed files
 // Reads tuples from stdin and inserts into Reln
-// Usage:  ./insert  [-v]  RelName
+// Usage:  ./insert  [-v]  [-m]  [-p]  [-w]  RelName
+// -m remembers attribute hashes, for data with many repeated values
+// -p pipelines reading, hashing and page writes on separate threads
+// -w logs changes to RelName.wal, committing in groups, so a crash
+//    can't leave the relation half-changed
 // Last modified by John Shepherd, July 2019
 
+#define _POSIX_C_SOURCE 200112L
+#include <pthread.h>
 #include "defs.h"
 #include "reln.h"
 #include "tuple.h"
+#include "ring.h"
 
-#define USAGE "./insert  [-v]  RelName"
+#define USAGE "./insert  [-v]  [-m]  [-p]  [-w]  RelName"
+
+// #tuples that can be queued between pipeline stages
+#define RINGSIZE 1024
+
+// a tuple on its way from the hash stage to the writer
+typedef struct { Tuple t; Bits hash; } Hashed;
+
+// state shared by the stages of a pipelined insert
+typedef struct {
+	Reln     r;
+	FILE    *in;
+	HashMemo memo;    // owned by the hash stage (or NULL)
+	Ring     lines;   // reader -> hasher: Tuple
+	Ring     hashed;  // hasher -> writer: Hashed *
+} Pipeline;
+
+static void *readStage(void *arg);
+static void *hashStage(void *arg);
+static void insertTuple(Reln r, Tuple t, Bits hash, int verbose);
+
+static Count nduplicates = 0;  // tuples not added, as their key was taken
 
 // Main ... process args, read/insert tuples
 
@@ -17,17 +45,32 @@ int main(int argc, char **argv)
 	Reln r;  // handle on the open relation
 	Tuple t;  // tuple buffer
 	char err[2*MAXERRMSG];  // buffer for error messages
-	char tup[MAXTUPLEN];  // buffer for printable tuples
 	int verbose;  // show extra info on query progress
+	int memo;     // memoise attribute hashes
+	int piped;    // use the multi-threaded pipeline
+	int logged;   // use the write-ahead log
 	char *rname;  // name of table/file
 
 	// process command-line args
 
 	if (argc < 2) fatal(USAGE);
-    if (strcmp(argv[1], "-v") == 0)
-		{ verbose = 1; rname = argv[2]; }
-	else
-		{ verbose = 0; rname = argv[1]; }
+	int arg = 1;
+	verbose = memo = piped = logged = 0;
+	while (arg < argc && argv[arg][0] == '-') {
+		if (strcmp(argv[arg], "-v") == 0)
+			verbose = 1;
+		else if (strcmp(argv[arg], "-m") == 0)
+			memo = 1;
+		else if (strcmp(argv[arg], "-p") == 0)
+			piped = 1;
+		else if (strcmp(argv[arg], "-w") == 0)
+			logged = 1;
+		else
+			fatal(USAGE);
+		arg++;
+	}
+	if (arg >= argc) fatal(USAGE);
+	rname = argv[arg];
 
 
 	// set up relation for writing
@@ -37,26 +80,57 @@ int main(int argc, char **argv)
 		fatal(err);
 	}
 	if ((r = openRelation(rname,"r+")) == NULL) {
-		sprintf(err, "Can't open relation: %s",argv[1]);
+		sprintf(err, "Can't open relation: %s",rname);
 		fatal(err);
 	}
+	if (logged) logRelation(r, rname);
 
-	// read stdin and insert tuples
+	HashMemo m = NULL;
+	if (!piped) {
+		// read stdin and insert tuples
 
-	while ((t = readTuple(r,stdin)) != NULL) {
-		PageID pid;
-		pid = addToRelation(r,t);
+		if (memo) useHashMemo(r);
+		m = hashMemo(r);
+		while ((t = readTuple(r,stdin)) != NULL) {
+			insertTuple(r, t, tupleHash(r,t), verbose);
+			free(t);
+		}
+	}
+	else {
+		// reader -> hasher -> this thread, which routes tuples
+		//   to buckets and does all page writes and splits
+		// the hash stage keeps a memo of its own, so the writer's
+		//   splits (which re-hash) never touch it
 
-		tupleString(t,tup); // printable version
-		if (pid == NO_PAGE) {
-			sprintf(err, "Insert of %s failed\n", tup);
-			fatal(err);
+		Pipeline p;
+		pthread_t reader, hasher;
+		p.r = r;  p.in = stdin;
+		p.memo = m = memo ? newHashMemo(hashfn(r)) : NULL;
+		p.lines = newRing(RINGSIZE);
+		p.hashed = newRing(RINGSIZE);
+		if (pthread_create(&reader, NULL, readStage, &p) != 0
+		    || pthread_create(&hasher, NULL, hashStage, &p) != 0)
+			fatal("Can't start insert pipeline");
+		Hashed *h;
+		while ((h = ringGet(p.hashed)) != NULL) {
+			insertTuple(r, h->t, h->hash, verbose);
+			free(h->t);
+			free(h);
 		}
-		if (verbose) printf("%s -> %d\n",tup,pid);
-		free(t);
-		// relationStats(r);
-		// Display(r);
+		pthread_join(reader, NULL);
+		pthread_join(hasher, NULL);
+		freeRing(p.lines);
+		freeRing(p.hashed);
+	}
+
+	if (verbose && m != NULL) {
+		Count hits, misses;
+		memoStats(m, &hits, &misses);
+		printf("hash memo: %d hits, %d misses\n", hits, misses);
 	}
+	if (piped && m != NULL) freeHashMemo(m);
+	if (nduplicates > 0)
+		fprintf(stderr, "%d tuples had a key already in %s\n", nduplicates, rname);
 
 	// clean up
 	closeRelation(r);
@@ -64,3 +138,56 @@ int main(int argc, char **argv)
 	return 0;
 }
 
+// add one tuple; give up on the whole insert if it fails,
+// but just skip it if its key is taken
+
+static void insertTuple(Reln r, Tuple t, Bits hash, int verbose)
+{
+	char err[2*MAXERRMSG];  // buffer for error messages
+	char tup[MAXTUPLEN];  // buffer for printable tuples
+	PageID pid;
+	pid = addHashedToRelation(r,t,hash);
+
+	tupleString(t,tup); // printable version
+	if (pid == NO_PAGE) {
+		sprintf(err, "Insert of %s failed\n", tup);
+		fatal(err);
+	}
+	if (pid == DUPLICATE_KEY) {
+		if (verbose) printf("%s: duplicate key\n",tup);
+		nduplicates++;
+		return;
+	}
+	if (verbose) printf("%s -> %d\n",tup,pid);
+	// relationStats(r);
+	// Display(r);
+}
+
+// pipeline stage 1: read and check lines from the input
+
+static void *readStage(void *arg)
+{
+	Pipeline *p = arg;
+	Tuple t;
+	while ((t = readTuple(p->r, p->in)) != NULL)
+		ringPut(p->lines, t);
+	ringClose(p->lines);
+	return NULL;
+}
+
+// pipeline stage 2: compute choice-vector hashes
+
+static void *hashStage(void *arg)
+{
+	Pipeline *p = arg;
+	Tuple t;
+	while ((t = ringGet(p->lines)) != NULL) {
+		Hashed *h = malloc(sizeof(Hashed));
+		assert(h != NULL);
+		h->t = t;
+		h->hash = tupleHashMemo(p->r, t, p->memo);
+		ringPut(p->hashed, h);
+	}
+	ringClose(p->hashed);
+	return NULL;
+}
@@ -0,0 +1,47 @@
+// lock.c ... advisory locks on ranges of files
+// part of Multi-attribute Linear-hashed Files
+// Thin wrapper around fcntl() record locks
+// Ranges may lie past the end of the file, so locks that
+//   don't guard any data (latches) can use high offsets
+
+#define _POSIX_C_SOURCE 200112L
+#include <fcntl.h>
+#include <errno.h>
+#include "defs.h"
+#include "lock.h"
+
+// lock len bytes from start, in shared or exclusive mode
+// if wait, blocks until the lock is granted; otherwise
+//   returns ~OK straight away if it conflicts
+// callers rely on a lock they wait for being held afterwards,
+//   so any failure of one (e.g. EDEADLK, ENOLCK) is fatal
+
+Status lockRange(FILE *f, Offset start, Offset len, int mode, Bool wait)
+{
+	struct flock fl;
+	fl.l_type = (mode == LOCK_EXCL) ? F_WRLCK : F_RDLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = start;
+	fl.l_len = len;
+	for (;;) {
+		if (fcntl(fileno(f), wait ? F_SETLKW : F_SETLK, &fl) == 0)
+			return OK;
+		if (wait && errno == EINTR) continue;
+		if (wait) {
+			perror("lockRange");
+			abort();
+		}
+		return ~OK;
+	}
+}
+
+void unlockRange(FILE *f, Offset start, Offset len)
+{
+	struct flock fl;
+	fl.l_type = F_UNLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = start;
+	fl.l_len = len;
+	int ok = fcntl(fileno(f), F_SETLK, &fl);
+	assert(ok == 0);
+}
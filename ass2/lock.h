@@ -0,0 +1,18 @@
+// lock.h ... interface to advisory locks on ranges of files
+// part of Multi-attribute Linear-hashed Files
+// Locks are held by processes (not threads), and conflict
+//   with locks on overlapping ranges held by other processes
+// See lock.c for details on functions
+
+#ifndef LOCK_H
+#define LOCK_H 1
+
+#include "defs.h"
+
+#define LOCK_SHARED 0
+#define LOCK_EXCL   1
+
+Status lockRange(FILE *f, Offset start, Offset len, int mode, Bool wait);
+void unlockRange(FILE *f, Offset start, Offset len);
+
+#endif
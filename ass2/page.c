@@ -3,8 +3,13 @@
 // Reading/writing pages into buffers and manipulating contents
 // Last modified by John Shepherd, July 2019
 
+#define _POSIX_C_SOURCE 200809L
+#include <unistd.h>
 #include "defs.h"
 #include "page.h"
+#include "wal.h"
+
+static PageID fileEnd(FILE *f);
 
 // internal representation of pages
 struct PageRep {
@@ -50,13 +55,9 @@ Page newPage()
 // append a new Page to a file; return its PageID
 PageID addPage(FILE *f)
 {
-	int ok = fseek(f, 0, SEEK_END);
-	assert(ok == 0);
-	int pos = ftell(f);
-	assert(pos >= 0);
-	PageID pid = pos/PAGESIZE;
+	PageID pid = fileEnd(f);
 	Page p = newPage();
-	ok = putPage(f, pid, p);
+	int ok = putPage(f, pid, p);
 	assert(ok == 0);
 	return pid;
 }
@@ -75,13 +76,9 @@ PageID addNewoverflowPage(FILE *_f, Reln _r)
 	}
 
 	// no empty page
-	int ok = fseek(_f, 0, SEEK_END);
-	assert(ok == 0);
-	int pos = ftell(_f);
-	assert(pos >= 0);
-	PageID pid = pos/PAGESIZE;
+	PageID pid = fileEnd(_f);
 	Page p = newPage();
-	ok = putPage(_f, pid, p);
+	int ok = putPage(_f, pid, p);
 	assert(ok == 0);
 	return pid;
 }
@@ -92,9 +89,11 @@ Page getPage(FILE *f, PageID pid)
 	assert(pid >= 0);
 	Page p = malloc(PAGESIZE);
 	assert(p != NULL);
-	int ok = fseek(f, pid*PAGESIZE, SEEK_SET);
-	assert(ok == 0);
-	int n = fread(p, 1, PAGESIZE, f);
+	// pages changed since the last commit are only in the log's buffer
+	if (walGetPage(f, pid, p, PAGESIZE)) return p;
+	// one pread() rather than fseek()+fread(): f is unbuffered
+	//   (see openRelation()), and a page is all we want from it
+	ssize_t n = pread(fileno(f), p, PAGESIZE, (off_t)pid*PAGESIZE);
 	assert(n == PAGESIZE);
 	return p;
 }
@@ -111,10 +110,8 @@ Page getPageCertainInfo(FILE *f, PageID pid)
 	 */
 	Page p = malloc( sizeof( Offset ) * 3 );
 	assert(p != NULL);
-	// move to target page
-	int ok = fseek(f, pid*PAGESIZE, SEEK_SET);
-	assert(ok == 0);
-	int n = fread(p, 1, ( sizeof( Offset ) * 3 ), f);
+	if (walGetPage(f, pid, p, sizeof( Offset ) * 3)) return p;
+	ssize_t n = pread(fileno(f), p, sizeof( Offset ) * 3, (off_t)pid*PAGESIZE);
 	assert( n == sizeof( Offset ) * 3 );
 	return p;
 }
@@ -123,9 +120,9 @@ Page getPageCertainInfo(FILE *f, PageID pid)
 Status putPage(FILE *f, PageID pid, Page p)
 {
 	assert(pid >= 0);
-	int ok = fseek(f, pid*PAGESIZE, SEEK_SET);
-	assert(ok == 0);
-	int n = fwrite(p, 1, PAGESIZE, f);
+	// if f is being logged, the log keeps p until commit
+	if (walPutPage(f, pid, p)) return 0;
+	ssize_t n = pwrite(fileno(f), p, PAGESIZE, (off_t)pid*PAGESIZE);
 	assert(n == PAGESIZE);
 	free(p);
 	return 0;
@@ -244,3 +241,15 @@ void deleteNodeFatherIsMain( FILE * _father_handler, FILE * _son_handler, PageID
 	// free(fatherPage);
 	// free(sonPage);
 }
+
+// #pages in a file, i.e. the PageID of the next one appended
+static PageID fileEnd(FILE *f)
+{
+	PageID npages;
+	if (walFileEnd(f, &npages)) return npages;
+	int ok = fseek(f, 0, SEEK_END);
+	assert(ok == 0);
+	int pos = ftell(f);
+	assert(pos >= 0);
+	return pos/PAGESIZE;
+}
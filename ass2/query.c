@@ -4,6 +4,8 @@
 // Last modified by John Shepherd, July 2019
 
 
+#include <math.h>
+#include <limits.h>
 #include "defs.h"
 #include "query.h"
 #include "reln.h"
@@ -12,24 +14,88 @@
 // include 2 more .h file
 #include "bits.h"
 #include "hash.h"
+#include "sig.h"
+#include "roaring.h"
 
-Bool moveToNextPage( Query _q, Page _current_page );
 char * readtupleInQuery( char * start, char * end );
-Bool checkValidHashBit( PageID _currMainPageID, int _how_many_bits, Bits _known, Bits _known_pos );
+static PageID nextBucket( Query _q, PageID _b );
+static void loadBucket( Query _q, PageID _b );
+static Query newQuery( Reln r, char *q, Bool writer );
+static Bool splitValues( Query _q, int _i );
+static Count rangeHashes( Query _q, int _i, Bits **_hashes );
+static int byBits( const void *_a, const void *_b );
+static double planIndex( Query _q );
+static double planBitmaps( Query _q, double _best );
+static void planSignatures( Query _q, double _best );
+static Bool bucketAgrees( Query _q, PageID _b );
+static Count candidateBuckets( Query _q );
+static void combineValues( Query _q, ChVecPlan *_plan, Bits **_hashes, Count *_nhashes, Bits _attrs, Bits _mask );
+static Bool queryMatch( Query _q, char *_t );
+static char *nextMatch( Query q );
+static PageID slotBucket( Query _q, Bits _s );
+static int bySlotBucket( const void *_a, const void *_b );
+
+// most combinations of IN-list values that buckets are found for
+#define MAXCOMBOS 4096
 
 // A suggestion ... you can change however you like
 struct QueryRep {
 	Reln    rel;       // need to remember Relation info
-	Bits    known;     // the hash value from MAH
 	Bits    known_pos;   // which pos is known
-	PageID  curMainPage;   // current main page in scan
-	PageID  curOvPage;	
-	int     is_ovflow; // are we in the overflow pages?
+	Bits   *combos;    // known hash bits, for each combination of
+	                   // the values in IN-lists (just one if none)
+	PageID *cursors;   // next bucket for each of them (see nextBucket())
+	Count   ncombos;
+	ValueProbe probe;  // known values, for skipping pages by filter
+	Bool    unique;    // binds the relation's key: at most one match
+	Count   nattrs;
+	char   *vals[MAXATTRS];  // the query's values
+	char  **alts[MAXATTRS];  // the values allowed for each attribute
+	Count   nalts[MAXATTRS]; // (pointing into vals), or 0 if any is
+	Bool    ranged[MAXATTRS]; // or a range of ints lo..hi (see splitValues())
+	long long lo[MAXATTRS], hi[MAXATTRS];
+	PageID  curMainPage;   // current bucket in scan
+	PageID  loaded;    // bucket whose pages are in 'pages'
+	Page   *pages;     // all pages of current bucket, from readBucket()
+	Count   npages;    // #pages in 'pages'
+	Count   curpage;   // index of current page in 'pages'
+	Count   curtupno;  // #tuples already looked at in current page
 	Offset  curtup;    // offset of current tuple within page
+	Count   lastpage;  // where the tuple last returned is
+	Offset  lasttup;
+
+	// for startUpdate(), which can change the tuples it finds
+	Bool    writer;
+	PageID *pids;      // ids of 'pages', from getBucket()
+	Bool   *changed;   // which of 'pages' need writing back
+	Count   ndeleted;  // #tuples deleted from current bucket
+
+	// for sampleQuery(): the scan only reads the buckets of some
+	// of the hash slots (d+1 bits) the query could match
+	Bits   *slots;     // those slots, or NULL if not sampling
+	Count  *slotHits;  // #matches found in each
+	Count   nslots;
+	Count   curslot;   // index in slots of the one being scanned
+	Count   allslots;  // #slots the query could match
+
+	// for a scan that uses a secondary index (see planIndex()),
+	// bitmap indexes (see planBitmaps()) or the signature file
+	// (see planSignatures())
+	int     indexed;   // the attribute whose index it uses, or -1
+	PageID *ibuckets;  // the buckets any of them gives, in order
+	Count   nibuckets;
+	Count   npostings; // #hashes the index gave for them
+	Bits    bitmapped; // attributes whose bitmaps it ANDs, or 0
+	Count   nbslots;   // #hash slots they gave
+	Bool    sigscan;   // whether ibuckets are from the signatures
+	Count   nsigmatch; // #signatures that matched
+
+	// for explainQuery() and queryCounts()
+	Count   pagesRead;   // #pages read so far
+	Count   tuplesSeen;  // #tuples checked against the query so far
 
 	int  int_depth;		// depth (constant)
 	char *str_query;	// query (constant)
-	char *str_data;		// data in tuple (variable)
 
 };
 
@@ -49,8 +115,27 @@ int queryIsValid(Reln r, char *q)
 
 
 // take a query string (e.g. "1234,?,abc,?")
+// a value can also be a list of values, any of which matches
+// (e.g. "1234|5678,?,abc,?"); the buckets for all of them are
+// read in one pass, each bucket once
+// or a range of ints (e.g. "?,100..200,?,?"), which only narrows
+// down the buckets for an order-preserving attribute
 // set up a QueryRep object for the scan
 Query startQuery(Reln r, char *q)
+{
+	return newQuery(r, q, FALSE);
+}
+
+// as for startQuery(), but deleteCurrentTuple() can be used
+// on the tuples it finds
+// like an insert, holds the split latch (shared) throughout,
+// and each bucket's latch (exclusive) while scanning it
+Query startUpdate(Reln r, char *q)
+{
+	return newQuery(r, q, TRUE);
+}
+
+static Query newQuery( Reln r, char *q, Bool writer )
 {
 	Query new = malloc(sizeof(struct QueryRep));
 	assert(new != NULL);
@@ -61,52 +146,94 @@ Query startQuery(Reln r, char *q)
 		return NULL;
 	}
 
+	// snapshot of depth and sp; buckets are enumerated as they
+	// were now, even if splits happen during the scan
+	// (writers don't let any happen)
+	if (writer)
+		latchSplit(r, LOCK_SHARED);
+	else
+		refreshRelation(r);
+
 	// number of values in 'r'
 	Count nvals = nattrs(r);
-	// assign space of size 'nvals' to '**vals' (2D-array)
-	char **vals = malloc(nvals * sizeof(char *));
-	// assert check if malloc fails
-	assert(vals != NULL);
-	// extract values into a 2D-array of strings
-	// (char *q == Tuple t)
-	tupleVals(q, vals);
+	// extract values into an array of strings
+	// (char *q == Tuple t), and split IN-lists at '|'
+	tupleVals(q, new -> vals);
 
 	// initilize some variables
-	Bits hash_value_array[nvals], the_known = 0x00000000, temp_pos = 0x00000000;
-	ChVecItem *cv = chvec(r);
-	ChVecItem curr_cv;	// curr_cv = cv[i]
+	Bits *hash_value_array[MAXATTRS], temp_pos;
+	Count nhashes[MAXATTRS];	// #hashes in each of them
+	Bits known_attrs = 0;	// which attributes have values
+	ChVecPlan *plan = chvecPlan(r);
 	int the_depth = depth(r);
 
 	int i;
+	Count j;
+	new -> rel = r;
+	new -> int_depth = the_depth;
+	new -> probe.known = 0;
 	for (i = 0; i < nvals; i++) {
-		// if value == "?", then set hash value to 0(int type)
-		// else, convert value(string type) to hash value(int type)
-		hash_value_array[i] = (strcmp(vals[i], "?") == 0) ? 0x00000000 : hash_any((unsigned char *)vals[i], strlen(vals[i]));
+		hash_value_array[i] = NULL;
+		// "?" contributes nothing (nor does an IN-list with "?" in it)
+		if (!splitValues( new, i )) continue;
+		// a range: the hashes of the places it covers, if it can
+		if (new -> ranged[i]) {
+			nhashes[i] = rangeHashes( new, i, &hash_value_array[i] );
+			if (nhashes[i] > 0) known_attrs |= 1u << i;
+			continue;
+		}
+		// hash the known values
+		nhashes[i] = new -> nalts[i];
+		hash_value_array[i] = malloc(new -> nalts[i] * sizeof(Bits));
+		assert(hash_value_array[i] != NULL);
+		for (j = 0; j < new -> nalts[i]; j++)
+			hash_value_array[i][j] = attrHash(r, i, new -> alts[i][j]);
+		known_attrs |= 1u << i;
+		// page filters can only test single values
+		if (new -> nalts[i] == 1) {
+			new -> probe.known |= 1u << i;
+			new -> probe.hash[i] = valueHash(r, new -> alts[i][0]);
+		}
 	}
+	new -> nattrs = nvals;
+	Bits key = keyAttrs(r);
+	new -> unique = key != 0 && (new -> probe.known & key) == key;
 
-	// get the_known and the_unknown
-	for (i = 0; i < MAXCHVEC; i++) {
-		curr_cv = cv[i];
-		the_known = ( bitIsSet(hash_value_array[curr_cv.att], curr_cv.bit) ) ? setBit(the_known, i) : unsetBit(the_known, i);
-		// if vals[curr_cv.att] == "?", then bitwise left shift
-		temp_pos = (strcmp(vals[curr_cv.att], "?") != 0) ? temp_pos | (1 << i) : temp_pos;
+	// which positions of the hash are known, and their values for
+	// each combination of the attributes' values, using the choice
+	// vector compiled at openRelation()
+	// too many combinations, and the attribute with most values
+	// just doesn't narrow down the buckets (it's still matched)
+	for (;;) {
+		Count ncombos = 1;
+		int widest = -1;
+		for (i = 0; i < nvals; i++) {
+			if (!bitAt(known_attrs, i)) continue;
+			ncombos *= nhashes[i];
+			if (widest < 0 || nhashes[i] > nhashes[widest]) widest = i;
+		}
+		if (ncombos <= MAXCOMBOS) break;
+		known_attrs &= ~(1u << widest);
 	}
-	void bitsString(Bits val, char *buf);
+	temp_pos = chvecPositions(plan, known_attrs);
+	combineValues( new, plan, hash_value_array, nhashes, known_attrs,
+	               lowerBits( temp_pos, the_depth + 1 ) );
+	for (i = 0; i < nvals; i++) free(hash_value_array[i]);
 
 	// assign value to elements in structure 'QueryRep'
-	new -> rel        =  r;
-	new -> known      =  the_known;
 	new -> known_pos  =  temp_pos;
-	new -> curMainPage=  0; // possible bug
-	new -> curOvPage  =  NO_PAGE;
-	new -> is_ovflow  =  0;
-	new -> curtup     =  0;
-	new -> int_depth  =  the_depth;
+	new -> slots      =  NULL;
+	new -> slotHits   =  NULL;
+	new -> pagesRead  =  0;
+	new -> tuplesSeen =  0;
+	planSignatures( new, planBitmaps( new, planIndex( new ) ) );
+	new -> curMainPage=  nextBucket( new, NO_PAGE );
+	new -> loaded     =  NO_PAGE;
+	new -> pages      =  NULL;
+	new -> npages     =  0;
+	new -> writer     =  writer;
 	new -> str_query  =  q;
-	new -> str_data   =  "EmptyString";
-
-	// free 'vals' because it has allocated memory using 'malloc'
-	freeVals(vals, nvals);
+	// the first bucket is read when the scan starts
 
 	// return struct 'new' which is initialized
 	return new;
@@ -115,174 +242,153 @@ Query startQuery(Reln r, char *q)
 
 // get next tuple during a scan
 Tuple getNextTuple(Query q)
-{	
-	Page current_page;
-	// initialize
-	if( q->is_ovflow == 0 ) {
-		current_page = getPage(dataFile(q->rel), q->curMainPage);
-	}
-	else{
-		current_page = getPage(ovflowFile(q->rel), q->curOvPage);
-	}
-
-	// update q->str_data if current_page changed
-	// get tuple parts start at rel->data[0]
-	q->str_data = pageData(current_page);
-
-	// set the inistal pos to right offset
-	// initial can only change when reading another ov or main page
-	char *initial = q->str_data + q->curtup;
-	char *start = initial;
-
-	// this page's all tuples are checked
-	char *end = NULL;
-	char *last_end = NULL;
-	char *curr = start;
-	for( ; ; ) {
-		if( *curr != '\0' && start != NULL ) {
-			q->curtup++;
-			curr = curr + 1;
-			continue;
-		}	
-		
-		// a new tuple start
-		if( *curr != '\0' && start == NULL ) {
-			q->curtup++;
-			start = curr;
-			curr = curr + 1;
-			continue;
-		}
-
-		// a tuple ends
-		if( *curr == '\0' && start != NULL && curr != initial ) {
-			q->curtup++;
-			end = curr;
-			Tuple resultTuple = readtupleInQuery( start, end );
-			Bool matchResult = tupleMatch( q->rel, q->str_query, resultTuple );
-			// if matches
-			if( matchResult == TRUE ) {
-				free(current_page);
-				return resultTuple;
-			}
-			start = NULL;
-			end = NULL;
-			last_end = curr;
-			curr = curr + 1;
-			continue;
-		}
+{
+	char *t = nextMatch( q );
+	if( t == NULL ) return NULL;
+	return readtupleInQuery( t, t + strlen( t ) );
+}
 
-		// this page no longer has tuples from current pos
-		// or no tuple at all
-		if( *curr == '\0' && curr == initial ) {
-			Bool temp_result = moveToNextPage( q, current_page );
-			if( temp_result == FALSE ){
-				// moveToNextPage() help us free(current_page)
-				// free(current_page);
-				break;
-			}
-			initial = q->str_data;
-			start = initial;
-			curr = start;
-			continue;
-		}
+/**
+ * #tuples the query matches (those still to come, if the scan
+ * has started), but no more than _limit (unless it's 0)
+ * tuples aren't copied out of the pages, and a query that knows
+ * nothing is just answered from #tuples in the header
+ */
+Count countMatches( Query _q, Count _limit )
+{
+	Count n = 0, i;
+	Bool any = _q->slots == NULL;
+	for( i = 0 ; i < _q->nattrs ; i++ ) any = any && _q->nalts[ i ] == 0;
+	if( any && _q->tuplesSeen == 0 ) {
+		n = ntuples( _q->rel );
+		_q->curMainPage = NO_PAGE;
+		return ( _limit > 0 && n > _limit ) ? _limit : n;
+	}
+	while( ( _limit == 0 || n < _limit ) && nextMatch( _q ) != NULL ) n++;
+	return n;
+}
 
-		// all tuples in current page is read
-		if( *curr == '\0' && last_end + 1 == curr ) {
-			Bool temp_result = moveToNextPage( q, current_page );
-			if( temp_result == FALSE ){
-				// moveToNextPage() help us free(current_page)
-				// free(current_page);
-				break;
+/**
+ * Where the next matching tuple is in the current bucket's pages
+ * (after loading the next bucket, if need be); NULL at the end
+ */
+static char *nextMatch( Query q )
+{
+	if( q->loaded != q->curMainPage ) loadBucket( q, q->curMainPage );
+	while( q->curMainPage != NO_PAGE ) {
+		for( ; q->curpage < q->npages ; q->curpage++ ) {
+			Page current_page = q->pages[ q->curpage ];
+			while( q->curtupno < pageNTuples( current_page ) ) {
+				char *start = pageData( current_page ) + q->curtup;
+				char *end = start + strlen( start );
+				q->curtup += end - start + 1;
+				q->curtupno++;
+				// deleted
+				if( *start == TOMBSTONE ) continue;
+				q->tuplesSeen++;
+				// if matches
+				if( queryMatch( q, start ) ) {
+					if( q->slots != NULL ) {
+						// an unsplit bucket holds two slots
+						Bits s = q->slots[ q->curslot ];
+						if( lowerBits( tupleHashQuiet( q->rel, start ), q->int_depth + 1 ) != s )
+							continue;
+						q->slotHits[ q->curslot ]++;
+					}
+					q->lastpage = q->curpage;
+					q->lasttup = start - pageData( current_page );
+					// the only match; the next call ends the scan
+					if( q->unique ) q->curMainPage = NO_PAGE;
+					return start;
+				}
 			}
-			initial = q->str_data;
-			start = initial;
-			curr = start;
-			last_end = NULL;
-			continue;
+			q->curtup = 0;
+			q->curtupno = 0;
 		}
-		
+		// all pages of this bucket are checked
+		q->curMainPage = nextBucket( q, q->curMainPage );
+		loadBucket( q, q->curMainPage );
 	}
 	return NULL;
 }
 
 /**
- * 1. from main page to its ov
- * 2. from main page to next main
- * 3. from ov to next main
- * 4. from ov to ov
+ * Mark the tuple last returned by getNextTuple() as deleted
+ * (the scan must be from startUpdate())
+ * the page is written back when the scan leaves the bucket
  */
-Bool moveToNextPage( Query _q, Page _current_page )
+void deleteCurrentTuple( Query _q )
 {
-	// 1 or 4
-	if( pageOvflow(_current_page) != NO_PAGE ) {
-		_q->curOvPage = pageOvflow(_current_page);
-		free(_current_page);
-		_current_page = getPage( ovflowFile(_q->rel), _q->curOvPage );
-		_q->str_data = pageData(_current_page);
-		
-		_q->is_ovflow = 1;
-		_q->curtup = 0;
+	assert( _q->writer && _q->loaded != NO_PAGE );
+	pageData( _q->pages[ _q->lastpage ] )[ _q->lasttup ] = TOMBSTONE;
+	_q->changed[ _q->lastpage ] = TRUE;
+	_q->ndeleted++;
+}
+
+/**
+ * Overwrite the tuple last returned by getNextTuple() with _t,
+ * which must have the same hash value (indexes find tuples by it,
+ * and only get postings for the values that change)
+ * only works if _t is the same length; returns ~OK if not
+ */
+Status replaceCurrentTuple( Query _q, Tuple _t )
+{
+	assert( _q->writer && _q->loaded != NO_PAGE );
+	char *old = pageData( _q->pages[ _q->lastpage ] ) + _q->lasttup;
+	if( strlen( old ) != strlen( _t ) ) return ~OK;
+	// the indexes need the new values (at the same hash)
+	char prev[ MAXTUPLEN ];
+	strcpy( prev, old );
+	strcpy( old, _t );
+	_q->changed[ _q->lastpage ] = TRUE;
+	reindexTuple( _q->rel, prev, _t );
+	return OK;
+}
+
+/**
+ * Finish with the bucket in _q->pages (writing back any changes),
+ * then read the pages of bucket _b (nothing if NO_PAGE) that may
+ * hold a match; a writer reads them all, to put them back
+ * a reader's latches are only held inside readBucket(),
+ * so a slow caller of getNextTuple() never holds up a split
+ */
+static void loadBucket( Query _q, PageID _b )
+{
+	Count i;
+	if( _q->writer && _q->loaded != NO_PAGE ) {
+		putBucket( _q->rel, _q->npages, _q->pages, _q->pids, _q->changed );
+		countDeleted( _q->rel, _q->ndeleted );
+		unlatchBucket( _q->rel, _q->loaded );
+		free( _q->pids );
+		free( _q->changed );
 	}
-	// 2 or 3
-	// read next main page or finished
 	else{
-		// all main and ov pages are done
-		if( _q->curMainPage == int_pow( 2, _q->int_depth ) - 1 + splitp(_q->rel) ) {
-			return FALSE;
+		for( i = 0 ; i < _q->npages ; i++ ) {
+			free( _q->pages[ i ] );
 		}
-		else{
-			_q->curMainPage++;
-			for( ; _q->curMainPage <= int_pow( 2, _q->int_depth ) - 1 + splitp(_q->rel) ; _q->curMainPage++ ){
-				/**
-				 * check if new _q->curMainPage is valid for known bits
-				 * 1. _q->curMainPage < _q->rel->sp, take depth + 1 bits
-				 * 2. _q->curMainPage >= _q->curMainPage && < 2^depth
-				 * 3. _q->curMainPage >= 2^depth && assert(_q->curMainPage < int_pow( 2, _q->int_depth ) - 1 + splitp(_q->rel))
-			 	*/ 
-				if( _q->curMainPage < _q->int_depth ) {
-					Bool temp_result = checkValidHashBit( _q->curMainPage, _q->int_depth + 1, _q->known, _q->known_pos );
-					if( temp_result == FALSE ) {
-						continue;
-					}
-					break;
-				}
-
-				if( _q->curMainPage >= _q->int_depth && _q->curMainPage < int_pow(2,_q->int_depth) ) {
-					Bool temp_result = checkValidHashBit( _q->curMainPage, _q->int_depth, _q->known, _q->known_pos );
-					if( temp_result == FALSE ) {
-						continue;
-					}
-					break;
-				}
-				if( _q->curMainPage >= int_pow(2,_q->int_depth) ) {
-					Bool temp_result = checkValidHashBit( _q->curMainPage, _q->int_depth + 1, _q->known, _q->known_pos );
-					if( temp_result == FALSE ) {
-						continue;
-					}
-					break;
-				}
-				/**
-				 * Attention, do not delete, if programs run here, then it means 
-		 		*/ 
-				assert( 1 == 0 );
-			}
-			if( _q->curMainPage > int_pow( 2, _q->int_depth ) - 1 + splitp(_q->rel) ) {
-				free(_current_page);
-				return FALSE;
-			}
-			_q->curOvPage = NO_PAGE;
-			free(_current_page);
-			_current_page = getPage( dataFile(_q->rel), _q->curMainPage );
-			_q->str_data = pageData(_current_page);
-
-			_q->is_ovflow = 0;
-			_q->curtup = 0;
- 		}
 	}
-	return TRUE;
+	free( _q->pages );
+	_q->pages = NULL;
+	_q->npages = 0;
+	_q->curpage = 0;
+	_q->curtupno = 0;
+	_q->curtup = 0;
+	_q->loaded = _b;
+	if( _b == NO_PAGE ) return;
+	if( !_q->writer ) {
+		_q->npages = readBucketMatching( _q->rel, _b, bucketDepth( _q->rel, _b ),
+		                                 &_q->probe, &_q->pages );
+		_q->pagesRead += _q->npages;
+		return;
+	}
+	latchBucket( _q->rel, _b, LOCK_EXCL );
+	_q->npages = getBucket( _q->rel, _b, &_q->pages, &_q->pids );
+	_q->pagesRead += _q->npages;
+	_q->changed = calloc( _q->npages, sizeof( Bool ) );
+	assert( _q->changed != NULL );
+	_q->ndeleted = 0;
 }
 
-
 char * readtupleInQuery( char * start, char * end )
 {
 	char * result = malloc( sizeof( char ) * ( end - start + 1 ) );
@@ -300,21 +406,635 @@ char * readtupleInQuery( char * start, char * end )
 	return result;
 }
 
-Bool checkValidHashBit( PageID _currMainPageID, int _how_many_bits, Bits _known, Bits _known_pos )
+/**
+ * Next bucket after _b whose hash bits agree with the known bits,
+ * or the first such bucket if _b is NO_PAGE; NO_PAGE when none are left
+ * (in increasing order; see nextBucketAgreeing())
+ */
+static PageID nextBucket( Query _q, PageID _b )
+{
+	PageID next = NO_PAGE;
+	Count c;
+	if( _q->slots != NULL ) {
+		// sampling: the bucket of the next slot (maybe the same one)
+		_q->curslot = ( _b == NO_PAGE ) ? 0 : _q->curslot + 1;
+		if( _q->curslot >= _q->nslots ) return NO_PAGE;
+		return slotBucket( _q, _q->slots[ _q->curslot ] );
+	}
+	if( _q->ibuckets != NULL ) {
+		// the first bucket from the index after _b
+		Count lo = 0, hi = _q->nibuckets;
+		while( _b != NO_PAGE && lo < hi ) {
+			Count mid = ( lo + hi ) / 2;
+			if( _q->ibuckets[ mid ] <= _b ) lo = mid + 1;
+			else hi = mid;
+		}
+		return ( lo < _q->nibuckets ) ? _q->ibuckets[ lo ] : NO_PAGE;
+	}
+	// merge the (increasing) buckets of each combination of values
+	for( c = 0 ; c < _q->ncombos ; c++ ) {
+		if( _b == NO_PAGE || _q->cursors[ c ] == _b ) {
+			_q->cursors[ c ] = nextBucketAgreeing( _q->int_depth, splitp( _q->rel ),
+			                                       _q->combos[ c ], _q->known_pos, _b );
+		}
+		if( _q->cursors[ c ] < next ) next = _q->cursors[ c ];
+	}
+	return next;
+}
+
+/**
+ * #buckets that agree with the known hash bits
+ */
+static Count candidateBuckets( Query _q )
 {
-	for( int i = 0 ; i < _how_many_bits ; i++ ) {
-		// this pos is known
-		if( extractBit( _known_pos, i ) == 1 ) {
-			if( extractBit( _currMainPageID, i ) != extractBit( _known, i ) ) {
-				return FALSE;
+	PageID *cursors = malloc( _q->ncombos * sizeof( PageID ) );
+	assert( cursors != NULL );
+	memcpy( cursors, _q->cursors, _q->ncombos * sizeof( PageID ) );
+	Count n = 0;
+	PageID b;
+	for( b = nextBucket( _q, NO_PAGE ) ; b != NO_PAGE ; b = nextBucket( _q, b ) ) n++;
+	memcpy( _q->cursors, cursors, _q->ncombos * sizeof( PageID ) );
+	free( cursors );
+	return n;
+}
+
+/**
+ * Scan through a secondary index instead, if there's one on an
+ * attribute the query has values for (or a range of them) that
+ * reads fewer pages than the candidate buckets: the index gives
+ * the hashes of the tuples with those values, so only their
+ * buckets are read
+ * Its cost is the pages of it read, plus a page per bucket (its
+ * primary page); the candidate buckets' is a page each
+ * A search gives up once it has more hashes than the candidate
+ * buckets hold tuples, as it isn't going to do better then
+ * Returns the cost of the plan chosen, or -1 if there was no
+ * index to compare
+ */
+static double planIndex( Query _q )
+{
+	_q->indexed = -1;
+	_q->ibuckets = NULL;
+	_q->nibuckets = 0;
+	_q->npostings = 0;
+	int i;
+	Count c, k, max = 0;
+	double best = -1;
+	for( i = 0 ; i < _q->nattrs ; i++ ) {
+		if( _q->nalts[ i ] == 0 ) continue;
+		BTree t = attrIndex( _q->rel, i );
+		if( t == NULL ) continue;
+		if( best < 0 ) {
+			best = candidateBuckets( _q );
+			max = ( Count )ceil( best * ntuples( _q->rel ) / npages( _q->rel ) ) + 1;
+		}
+		Count n = 0, m, pages = 0, size = 64;
+		Bits *hashes = malloc( size * sizeof( Bits ) ), *h;
+		assert( hashes != NULL );
+		char lo[ 24 ], hi[ 24 ];
+		for( c = 0 ; c < _q->nalts[ i ] && n <= max ; c++ ) {
+			if( _q->ranged[ i ] ) {
+				sprintf( lo, "%lld", _q->lo[ i ] );
+				sprintf( hi, "%lld", _q->hi[ i ] );
+				m = btreeRange( t, lo, hi, max - n, &h, &pages );
 			}
+			else
+				m = btreeRange( t, _q->alts[ i ][ c ], _q->alts[ i ][ c ], max - n, &h, &pages );
+			if( n + m > size ) {
+				while( n + m > size ) size *= 2;
+				hashes = realloc( hashes, size * sizeof( Bits ) );
+				assert( hashes != NULL );
+			}
+			memcpy( hashes + n, h, m * sizeof( Bits ) );
+			n += m;
+			free( h );
+		}
+		_q->pagesRead += pages;
+		if( n > max ) {
+			free( hashes );
+			continue;
+		}
+		// their buckets, without repeats
+		for( k = 0 ; k < n ; k++ )
+			hashes[ k ] = slotBucket( _q, lowerBits( hashes[ k ], _q->int_depth + 1 ) );
+		qsort( hashes, n, sizeof( Bits ), byBits );
+		for( c = k = 0 ; c < n ; c++ )
+			if( k == 0 || hashes[ c ] != hashes[ k - 1 ] ) hashes[ k++ ] = hashes[ c ];
+		if( k + pages < best ) {
+			best = k + pages;
+			free( _q->ibuckets );
+			_q->ibuckets = hashes;
+			_q->nibuckets = k;
+			_q->npostings = n;
+			_q->indexed = i;
+		}
+		else
+			free( hashes );
+	}
+	return best;
+}
+
+/**
+ * Use bitmap indexes instead, if there are any on attributes the
+ * query has values (not ranges) for, and they read fewer pages
+ * than the plan so far (_best, or -1 as for planSignatures())
+ * Each attribute's bitmap is the OR of its values' ones, and
+ * ANDing those gives the hash slots that can hold a match, so
+ * their buckets (that agree with the known hash bits) are read
+ * Its cost is the pages of the indexes read, plus a page per
+ * bucket; a slot only picks out one bucket while d+1 <= SLOTBITS
+ * Returns the cost of the plan chosen
+ */
+static double planBitmaps( Query _q, double _best )
+{
+	_q->bitmapped = 0;
+	_q->nbslots = 0;
+	if( _q->int_depth + 1 > SLOTBITS ) return _best;
+	Bitmap all = NULL;
+	Bits used = 0, *keys, *slots;
+	Count pages = 0, c, k, n;
+	int i;
+	for( i = 0 ; i < _q->nattrs ; i++ ) {
+		if( _q->nalts[ i ] == 0 || _q->ranged[ i ] ) continue;
+		BitmapIndex x = attrBitmap( _q->rel, i );
+		if( x == NULL ) continue;
+		keys = malloc( _q->nalts[ i ] * sizeof( Bits ) );
+		assert( keys != NULL );
+		for( c = 0 ; c < _q->nalts[ i ] ; c++ )
+			keys[ c ] = valueHash( _q->rel, _q->alts[ i ][ c ] );
+		Bitmap b = bitmapIndexLookup( x, keys, _q->nalts[ i ], &pages );
+		free( keys );
+		if( all == NULL )
+			all = b;
+		else {
+			bitmapAnd( all, b );
+			freeBitmap( b );
 		}
+		used |= 1u << i;
+	}
+	if( all == NULL ) return _best;
+	_q->pagesRead += pages;
+	n = bitmapSlots( all, &slots );
+	freeBitmap( all );
+	// their buckets in the query's snapshot, without repeats
+	for( c = k = 0 ; c < n ; c++ ) {
+		PageID b = slotBucket( _q, lowerBits( slots[ c ], _q->int_depth + 1 ) );
+		if( bucketAgrees( _q, b ) ) slots[ k++ ] = b;
+	}
+	qsort( slots, k, sizeof( Bits ), byBits );
+	Count nslots = n;
+	for( c = n = 0 ; c < k ; c++ )
+		if( n == 0 || slots[ c ] != slots[ n - 1 ] ) slots[ n++ ] = slots[ c ];
+	if( _best < 0 ) _best = candidateBuckets( _q );
+	if( n + pages >= _best ) {
+		free( slots );
+		return _best;
+	}
+	free( _q->ibuckets );
+	_q->ibuckets = slots;
+	_q->nibuckets = n;
+	_q->indexed = -1;
+	_q->bitmapped = used;
+	_q->nbslots = nslots;
+	return n + pages;
+}
+
+/**
+ * Scan the signature file instead, if the relation has one and
+ * that reads fewer pages than the plan so far (_best, or -1 if
+ * it's the candidate buckets and they haven't been counted)
+ * The query's signature has the bits of its single values (IN-
+ * lists and ranges can't set any), and only buckets whose
+ * signatures have all of them, and that agree with the known
+ * hash bits, are read
+ * Its cost is the pages of the file, plus a page for each bucket
+ * expected to match falsely, from how full the signatures are
+ * (buckets that do hold matches are read by any plan)
+ */
+static void planSignatures( Query _q, double _best )
+{
+	_q->sigscan = FALSE;
+	_q->nsigmatch = 0;
+	Count k, width = signatureWidth( _q->rel, &k );
+	if( width == 0 || _q->probe.known == 0 ) return;
+	Byte query[ MAXSIGWIDTH / 8 ];
+	Count qbits = 0, nb = npages( _q->rel ), c, n;
+	int i;
+	memset( query, 0, sizeof( query ) );
+	for( i = 0 ; i < _q->nattrs ; i++ )
+		if( bitAt( _q->probe.known, i ) ) sigAdd( query, width, k, i, _q->probe.hash[ i ] );
+	for( c = 0 ; c < width / 8 ; c++ ) qbits += countBits( query[ c ] );
+	double values = ( double )ntuples( _q->rel ) / nb * _q->nattrs;
+	double cost = ceil( ( SIGHDR + ( double )nb * width / 8 ) / PAGESIZE )
+	              + nb * sigFalseMatch( width, k, values, qbits );
+	if( _best < 0 ) _best = candidateBuckets( _q );
+	if( cost >= _best ) return;
+
+	PageID *match;
+	Count pages = 0;
+	_q->nsigmatch = scanSignatures( _q->rel, query, &match, &pages );
+	_q->pagesRead += pages;
+	// their buckets in the query's snapshot, without repeats
+	for( c = n = 0 ; c < _q->nsigmatch ; c++ ) {
+		PageID b = slotBucket( _q, lowerBits( match[ c ], _q->int_depth + 1 ) );
+		if( bucketAgrees( _q, b ) ) match[ n++ ] = b;
+	}
+	qsort( match, n, sizeof( PageID ), byBits );
+	for( c = k = 0 ; c < n ; c++ )
+		if( k == 0 || match[ c ] != match[ k - 1 ] ) match[ k++ ] = match[ c ];
+	free( _q->ibuckets );
+	_q->ibuckets = match;
+	_q->nibuckets = k;
+	_q->indexed = -1;
+	_q->bitmapped = 0;
+	_q->sigscan = TRUE;
+}
+
+/**
+ * Does bucket _b agree with the known hash bits, for any of the
+ * combinations of values?
+ */
+static Bool bucketAgrees( Query _q, PageID _b )
+{
+	Bits known = lowerBits( _q->known_pos, bucketDepth( _q->rel, _b ) );
+	Count c;
+	for( c = 0 ; c < _q->ncombos ; c++ )
+		if( ( ( _b ^ _q->combos[ c ] ) & known ) == 0 ) return TRUE;
+	return FALSE;
+}
+
+/**
+ * Make the scan read only a random fraction (0..1] of the hash
+ * slots the query could match, at least one of them
+ * A slot is a setting of the lower d+1 bits of the hash: a bucket
+ * that has been split holds one, the others hold two (and only
+ * the matches in the sampled one of those are returned), so every
+ * tuple has the same chance of being in the sample
+ * Slots are chosen with Knuth's selection sampling, then read in
+ * bucket order; call before the scan starts
+ */
+void sampleQuery( Query _q, double _fraction, unsigned _seed )
+{
+	assert( !_q->writer && _q->loaded == NO_PAGE );
+	int d = _q->int_depth;
+	Bits fixed = lowerBits( _q->known_pos, d + 1 );
+	Bits end = ( Bits )( ( 1ULL << ( d + 1 ) ) - 1 );
+	Count per = 1u << ( d + 1 - countBits( fixed ) );
+	Count all = per * _q->ncombos, want, seen = 0, c;
+	Bits s;
+	want = ( Count )ceil( _fraction * all );
+	if( want < 1 ) want = 1;
+	if( want > all ) want = all;
+	_q->slots = malloc( want * sizeof( Bits ) );
+	_q->slotHits = calloc( want, sizeof( Count ) );
+	assert( _q->slots != NULL && _q->slotHits != NULL );
+	_q->nslots = 0;
+	_q->allslots = all;
+
+	// a xorshift generator, so as not to disturb rand()
+	unsigned x = ( _seed == 0 ) ? 1 : _seed;
+	for( c = 0 ; c < _q->ncombos ; c++ ) {
+		Bits w = _q->combos[ c ];
+		for( s = w ; ; s = nextAgreeing( s, fixed, w ) ) {
+			x ^= x << 13;  x ^= x >> 17;  x ^= x << 5;
+			// take s with probability (#still wanted)/(#still left)
+			if( ( double )x / 4294967296.0 * ( all - seen ) < want - _q->nslots )
+				_q->slots[ _q->nslots++ ] = s;
+			seen++;
+			if( ( s | fixed ) == end ) break;
+		}
+	}
+	assert( _q->nslots == want );
+
+	// in bucket order (sorting bucket:slot pairs)
+	unsigned long long *order = malloc( want * sizeof( unsigned long long ) );
+	assert( order != NULL );
+	for( c = 0 ; c < want ; c++ )
+		order[ c ] = ( unsigned long long )slotBucket( _q, _q->slots[ c ] ) << 32 | _q->slots[ c ];
+	qsort( order, want, sizeof( unsigned long long ), bySlotBucket );
+	for( c = 0 ; c < want ; c++ ) _q->slots[ c ] = ( Bits )order[ c ];
+	free( order );
+	_q->curMainPage = nextBucket( _q, NO_PAGE );
+}
+
+static int bySlotBucket( const void *_a, const void *_b )
+{
+	unsigned long long a = *( unsigned long long * )_a, b = *( unsigned long long * )_b;
+	return ( a > b ) - ( a < b );
+}
+
+/**
+ * The bucket holding hash slot _s: the slot itself if its bucket
+ * has been split, otherwise the bucket given by its lower d bits
+ */
+static PageID slotBucket( Query _q, Bits _s )
+{
+	Bits b = lowerBits( _s, _q->int_depth );
+	return ( b < splitp( _q->rel ) ) ? _s : b;
+}
+
+/**
+ * After a sampled scan: the #matches in all the slots the query
+ * could match, estimated from those in the sample, and the half
+ * width of its 95% confidence interval (from the variation between
+ * slots, with the finite population correction)
+ */
+void sampleEstimate( Query _q, double *_estimate, double *_halfwidth )
+{
+	double m = _q->nslots, M = _q->allslots, sum = 0, ss = 0;
+	Count c;
+	for( c = 0 ; c < _q->nslots ; c++ ) sum += _q->slotHits[ c ];
+	double mean = sum / m;
+	for( c = 0 ; c < _q->nslots ; c++ )
+		ss += ( _q->slotHits[ c ] - mean ) * ( _q->slotHits[ c ] - mean );
+	double var = ( m > 1 ) ? ss / ( m - 1 ) : 0;
+	*_estimate = M * mean;
+	*_halfwidth = 1.96 * M * sqrt( ( 1 - m / M ) * var / m );
+}
+
+/**
+ * #slots in the sample, and #slots the query could match
+ */
+void sampleSize( Query _q, Count *_sampled, Count *_all )
+{
+	*_sampled = _q->nslots;
+	*_all = _q->allslots;
+}
+
+/**
+ * Split the value for attribute _i of the query at each '|',
+ * into _q->alts[_i]; FALSE (and no values) if it's "?" or has
+ * "?" among its values, as any value matches then
+ * A value lo..hi (either end can be left out) is instead a
+ * range of ints, into _q->lo[_i] and _q->hi[_i]
+ */
+static Bool splitValues( Query _q, int _i )
+{
+	char *v = _q->vals[ _i ];
+	Count n = 1;
+	char *c;
+	_q->nalts[ _i ] = 0;
+	_q->alts[ _i ] = NULL;
+	_q->ranged[ _i ] = FALSE;
+	if( ( c = strstr( v, ".." ) ) != NULL && strchr( v, '|' ) == NULL ) {
+		*c = '\0';
+		_q->ranged[ _i ] = ( *v == '\0' || intValue( v, &_q->lo[ _i ] ) )
+		                && ( c[ 2 ] == '\0' || intValue( c + 2, &_q->hi[ _i ] ) );
+		if( *v == '\0' ) _q->lo[ _i ] = LLONG_MIN;
+		if( c[ 2 ] == '\0' ) _q->hi[ _i ] = LLONG_MAX;
+		*c = '.';
+	}
+	for( c = v ; *c != '\0' ; c++ ) n += ( *c == '|' );
+	char **alts = malloc( n * sizeof( char * ) );
+	assert( alts != NULL );
+	n = 0;
+	alts[ n++ ] = v;
+	for( c = v ; *c != '\0' ; c++ ) {
+		if( *c != '|' ) continue;
+		*c = '\0';
+		alts[ n++ ] = c + 1;
+	}
+	Count k;
+	for( k = 0 ; k < n ; k++ ) {
+		if( strcmp( alts[ k ], "?" ) == 0 ) {
+			free( alts );
+			return FALSE;
+		}
+	}
+	_q->alts[ _i ] = alts;
+	_q->nalts[ _i ] = n;
+	return TRUE;
+}
+
+/**
+ * The hashes that values of order-preserving attribute _i in
+ * its range can have, as far as the bits of it that the file
+ * uses go (see orderHash(): those are bits of the values'
+ * places, in reverse)
+ * The places from lo's to hi's are split into aligned blocks
+ * (2^k places, whose lower k bits take every setting); a block
+ * gives each setting of the used bits among its lower k, with
+ * its upper bits as they are
+ * 0 (and none) if _i isn't order-preserving, or the range
+ * gives more than MAXCOMBOS hashes, or every setting of them
+ */
+static Count rangeHashes( Query _q, int _i, Bits **_hashes )
+{
+	OrderSpec *o = orderSpec( _q->rel );
+	ChVecItem *cv = chvec( _q->rel );
+	int j, k;
+	Bits used = 0, s;
+	Count n = 0, c;
+	*_hashes = NULL;
+	if( !bitAt( o->attrs, _i ) ) return 0;
+	for( j = 0 ; j <= _q->int_depth ; j++ )
+		if( cv[ j ].att == _i ) used |= 1u << cv[ j ].bit;
+	used = reverseBits( used );
+	unsigned long long a = orderPlace( _q->lo[ _i ], o->lo[ _i ], o->hi[ _i ] );
+	unsigned long long b = orderPlace( _q->hi[ _i ], o->lo[ _i ], o->hi[ _i ] );
+	// an empty range still has to find nothing
+	if( b < a ) b = a;
+	Bits *h = malloc( MAXCOMBOS * sizeof( Bits ) );
+	assert( h != NULL );
+	while( a <= b ) {
+		for( k = 0 ; k < 32 && ( a & ( ( 2ULL << k ) - 1 ) ) == 0
+		            && a + ( 2ULL << k ) - 1 <= b ; k++ ) ;
+		Bits any = lowerBits( used, k );
+		if( any == used || n + ( 1u << countBits( any ) ) > MAXCOMBOS ) {
+			free( h );
+			return 0;
+		}
+		// each subset of the bits that take every setting
+		for( s = 0 ; ; s = ( s - any ) & any ) {
+			h[ n++ ] = reverseBits( ( ( Bits )a & used ) | s );
+			if( s == any ) break;
+		}
+		a += 1ULL << k;
+	}
+	// without repeats
+	qsort( h, n, sizeof( Bits ), byBits );
+	for( c = j = 0 ; c < n ; c++ )
+		if( c == 0 || h[ c ] != h[ j - 1 ] ) h[ j++ ] = h[ c ];
+	*_hashes = h;
+	return j;
+}
+
+static int byBits( const void *_a, const void *_b )
+{
+	Bits a = *( Bits * )_a, b = *( Bits * )_b;
+	return ( a > b ) - ( a < b );
+}
+
+/**
+ * The known hash bits (within _mask) for every combination of
+ * values of the attributes in _attrs, without repeats, from the
+ * _nhashes[i] hashes of the values of each; into _q->combos
+ */
+static void combineValues( Query _q, ChVecPlan *_plan, Bits **_hashes, Count *_nhashes, Bits _attrs, Bits _mask )
+{
+	Count pick[ MAXATTRS ] = { 0 };
+	Bits h[ MAXATTRS ];
+	Count i, c, n = 0, max = 1;
+	for( i = 0 ; i < _q->nattrs ; i++ )
+		if( bitAt( _attrs, i ) ) max *= _nhashes[ i ];
+	_q->combos = malloc( max * sizeof( Bits ) );
+	_q->cursors = malloc( max * sizeof( PageID ) );
+	assert( _q->combos != NULL && _q->cursors != NULL );
+	for( ; ; ) {
+		for( i = 0 ; i < _q->nattrs ; i++ )
+			if( bitAt( _attrs, i ) ) h[ i ] = _hashes[ i ][ pick[ i ] ];
+		Bits bits = chvecGather( _plan, h, _attrs ) & _mask;
+		for( c = 0 ; c < n && _q->combos[ c ] != bits ; c++ ) ;
+		if( c == n ) _q->combos[ n++ ] = bits;
+		// next combination, like an odometer
+		for( i = 0 ; i < _q->nattrs ; i++ ) {
+			if( !bitAt( _attrs, i ) ) continue;
+			if( ++pick[ i ] < _nhashes[ i ] ) break;
+			pick[ i ] = 0;
+		}
+		if( i == _q->nattrs ) break;
+	}
+	_q->ncombos = n;
+}
+
+/**
+ * Does tuple _t have one of the allowed values for each attribute?
+ * (compared in place, without copying its values out)
+ */
+static Bool queryMatch( Query _q, char *_t )
+{
+	Count i, k;
+	char *v = _t;
+	for( i = 0 ; i < _q->nattrs ; i++ ) {
+		size_t len = strcspn( v, "," );
+		if( _q->ranged[ i ] ) {
+			long long x;
+			char c = v[ len ];
+			v[ len ] = '\0';
+			Bool in = intValue( v, &x ) && _q->lo[ i ] <= x && x <= _q->hi[ i ];
+			v[ len ] = c;
+			if( !in ) return FALSE;
+		}
+		else if( _q->nalts[ i ] > 0 ) {
+			for( k = 0 ; k < _q->nalts[ i ] ; k++ ) {
+				if( strncmp( _q->alts[ i ][ k ], v, len ) == 0
+				    && _q->alts[ i ][ k ][ len ] == '\0' ) break;
+			}
+			if( k == _q->nalts[ i ] ) return FALSE;
+		}
+		v += len + ( v[ len ] == ',' );
 	}
 	return TRUE;
 }
 
+/**
+ * Show how _q will be answered, before getNextTuple() runs it:
+ * the hash bits the query fixes (0/1, or * where the values in
+ * its IN-lists differ) and leaves open (?),
+ * the buckets that agree with them, and how many pages those
+ * buckets hold now, from the lengths of their chains
+ */
+void explainQuery( Query _q )
+{
+	int d = _q->int_depth;
+	char bits[ MAXBITS + 1 ];
+	int i;
+	Count c;
+	// bit d only matters for buckets that have been split
+	// '*' is a known bit that differs between IN-list values
+	for( i = 0 ; i <= d ; i++ ) {
+		Bits agree = 1;
+		for( c = 1 ; c < _q->ncombos ; c++ )
+			agree &= bitAt( _q->combos[ c ] ^ _q->combos[ 0 ], i ) == 0;
+		if( !bitAt( _q->known_pos, i ) )
+			bits[ d - i ] = '?';
+		else
+			bits[ d - i ] = agree ? '0' + bitAt( _q->combos[ 0 ], i ) : '*';
+	}
+	bits[ d + 1 ] = '\0';
+
+	// the scan may have started; leave it where it was
+	PageID *cursors = malloc( _q->ncombos * sizeof( PageID ) );
+	assert( cursors != NULL );
+	memcpy( cursors, _q->cursors, _q->ncombos * sizeof( PageID ) );
+	Count nbuckets = 0, estimate = 0;
+	PageID b;
+	for( b = nextBucket( _q, NO_PAGE ) ; b != NO_PAGE ; b = nextBucket( _q, b ) ) {
+		nbuckets++;
+		estimate += chainLength( _q->rel, b );
+	}
+	memcpy( _q->cursors, cursors, _q->ncombos * sizeof( PageID ) );
+	free( cursors );
+	Count all = npages( _q->rel );
+	printf( "hash bits (d=%d, sp=%d): %s\n", d, splitp( _q->rel ), bits );
+	printf( "known bits: %d, unknown bits: %d\n",
+	        countBits( lowerBits( _q->known_pos, d + 1 ) ),
+	        d + 1 - countBits( lowerBits( _q->known_pos, d + 1 ) ) );
+	if( _q->ncombos > 1 ) printf( "value combinations: %d\n", _q->ncombos );
+	if( _q->indexed >= 0 )
+		printf( "index on attribute %d: %d hashes, in %d buckets\n",
+		        _q->indexed, _q->npostings, _q->nibuckets );
+	if( _q->bitmapped != 0 ) {
+		printf( "bitmap indexes on attributes" );
+		for( i = 0, c = 0 ; i < _q->nattrs ; i++ )
+			if( bitAt( _q->bitmapped, i ) ) printf( "%s%d", ( c++ > 0 ) ? "," : " ", i );
+		printf( ": %d slots, in %d buckets\n", _q->nbslots, _q->nibuckets );
+	}
+	if( _q->sigscan )
+		printf( "signature scan: %d signatures match, in %d buckets\n",
+		        _q->nsigmatch, _q->nibuckets );
+	printf( "candidate buckets: %d of %d%s\n", nbuckets, all,
+	        ( nbuckets == all ) ? " (full scan)" : "" );
+	printf( "estimated pages: %d\n", estimate );
+	if( _q->unique ) printf( "key bound: stops at the first match\n" );
+
+	// each known value's share of its attribute, if there are stats
+	AttrStats *st = loadStats( _q->rel );
+	if( st == NULL ) return;
+	double matches = ntuples( _q->rel );
+	for( i = 0 ; i < _q->nattrs ; i++ ) {
+		if( _q->nalts[ i ] == 0 ) continue;
+		double f = 0;
+		OrderSpec *o = orderSpec( _q->rel );
+		if( _q->ranged[ i ] ) {
+			// the part of an order-preserving attribute's range it
+			// covers (nothing is known about others)
+			if( !bitAt( o->attrs, i ) ) continue;
+			double lo = ( _q->lo[ i ] > o->lo[ i ] ) ? _q->lo[ i ] : o->lo[ i ];
+			double hi = ( _q->hi[ i ] < o->hi[ i ] ) ? _q->hi[ i ] : o->hi[ i ];
+			f = ( hi < lo ) ? 0 : ( hi - lo + 1 ) / ( ( double )o->hi[ i ] - o->lo[ i ] + 1 );
+		}
+		else for( c = 0 ; c < _q->nalts[ i ] ; c++ )
+			f += statsFraction( &st[ i ], valueHash( _q->rel, _q->alts[ i ][ c ] ) );
+		matches *= ( f < 1 ) ? f : 1;
+	}
+	printf( "estimated matches: %.0f\n", matches );
+	free( st );
+}
+
+/**
+ * #pages read, and #tuples checked against the query, so far
+ */
+void queryCounts( Query _q, Count *_pages, Count *_tuples )
+{
+	*_pages = _q->pagesRead;
+	*_tuples = _q->tuplesSeen;
+}
+
 // clean up a QueryRep object and associated data
 void closeQuery(Query q)
 {
+	loadBucket( q, NO_PAGE );
+	if( q->writer ) unlatchSplit( q->rel );
+	Count i;
+	for( i = 0 ; i < q->nattrs ; i++ ) {
+		free( q->vals[ i ] );
+		free( q->alts[ i ] );
+	}
+	free( q->combos );
+	free( q->cursors );
+	free( q->slots );
+	free( q->slotHits );
+	free( q->ibuckets );
 	free(q);
 }
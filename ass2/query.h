@@ -12,7 +12,16 @@ typedef struct QueryRep *Query;
 #include "tuple.h"
 
 Query startQuery(Reln, char *);
+Query startUpdate(Reln, char *);
 Tuple getNextTuple(Query);
+Count countMatches(Query, Count);
+void deleteCurrentTuple(Query);
+Status replaceCurrentTuple(Query, Tuple);
+void explainQuery(Query);
+void sampleQuery(Query, double, unsigned);
+void sampleEstimate(Query, double *, double *);
+void sampleSize(Query, Count *, Count *);
+void queryCounts(Query, Count *, Count *);
 void closeQuery(Query);
 
 #endif
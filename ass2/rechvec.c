@@ -0,0 +1,68 @@
+// rechvec.c ... give a relation a new choice vector
+// part of Multi-attribute linear-hashed files
+// Builds a copy of the relation, with the same buckets but the
+//   new choice vector, in RelName.new, then moves it into place
+// Scans carry on against the old version while the copy is
+//   built; inserts and deletes wait, then go to the new version
+// Usage:  ./rechvec  [-v]  RelName  ChoiceVector
+// where ChoiceVector = attr,bit:attr,bit:... (as for create)
+// -v shows the new choice vector
+
+#include "defs.h"
+#include "reln.h"
+
+#define USAGE "./rechvec  [-v]  RelName  ChoiceVector"
+
+// Main ... process args, rebuild relation
+
+int main(int argc, char **argv)
+{
+	char err[MAXERRMSG];  // buffer for error messages
+	int verbose;  // show the new choice vector
+	char *rname;  // name of table/file
+	char *cv;     // new choice vector
+	char tmpname[MAXFILENAME];  // name of the copy
+
+	// process command-line args
+
+	if (argc < 3) fatal(USAGE);
+	if (strcmp(argv[1], "-v") == 0) {
+		if (argc < 4) fatal(USAGE);
+		verbose = 1;  rname = argv[2];  cv = argv[3];
+	}
+	else {
+		verbose = 0;  rname = argv[1];  cv = argv[2];
+	}
+	if (strlen(rname) + 4 > MAXRELNAME) fatal("Relation name too long");
+	sprintf(tmpname, "%s.new", rname);
+
+	if (!existsRelation(rname)) {
+		sprintf(err, "No such relation: %s",rname);
+		fatal(err);
+	}
+	Reln r = openRelation(rname,"r+");
+	if (r == NULL) {
+		sprintf(err, "Can't open relation: %s",rname);
+		fatal(err);
+	}
+
+	// nothing can change r from here until it's replaced
+
+	latchSplit(r, LOCK_EXCL);
+	if (copyRelation(r, tmpname, cv) != OK) {
+		sprintf(err, "Invalid choice vector: %.50s", cv);
+		fatal(err);
+	}
+	replaceRelation(r, tmpname);
+	unlatchSplit(r);
+	printf("Rehashed %d tuples\n", ntuples(r));
+	closeRelation(r);
+
+	if (verbose) {
+		r = openRelation(rname,"r");
+		printChVec(chvec(r));
+		closeRelation(r);
+	}
+
+	return 0;
+}
@@ -2,6 +2,7 @@
 // part of Multi-attribute Linear-hashed Files
 // Last modified by John Shepherd, July 2019
 
+#define _POSIX_C_SOURCE 200809L
 #include "defs.h"
 #include "reln.h"
 #include "page.h"
@@ -9,11 +10,58 @@
 #include "chvec.h"
 #include "bits.h"
 #include "hash.h"
-
+#include "lock.h"
+#include "wal.h"
+#include "sketch.h"
+#include "bloom.h"
+#include "btree.h"
+#include "sig.h"
+
+#include <unistd.h>
+#include <sys/stat.h>
 #include <string.h>
 #include <math.h>
-
-#define HEADERSIZE (3*sizeof(Count)+sizeof(Offset))
+#include <stddef.h>
+
+// #Count-sized fields at the start of RelnRep stored in R.info
+#define HEADERCOUNTS 14
+
+// kept in the header (and bumped whenever its layout, or that
+// of R.info, changes), so relations made by other versions of
+// these tools are refused rather than misread
+#define RELNVERSION 0x4c480001
+#define HEADERSIZE (HEADERCOUNTS*sizeof(Count)+MAXCHVEC*sizeof(ChVecItem))
+
+// latches between processes are locks on single bytes of
+// R.info, well past its end, plus one lock per bucket on
+// the bucket's primary page in R.data
+// always taken in the order split -> bucket -> header
+// - split latch: shared by scans and inserts, exclusive for splits
+// - bucket latch: shared to read a chain, exclusive to change it
+// - header latch: held briefly to read the header, or to update
+//   ntups or the free list
+// - swap latch: shared while opening the files, exclusive while
+//   replaceRelation() moves a new version of them into place
+// - key latches: one of KEYLATCHES, by the hash of the key, held
+//   (between the split and bucket latches) by an insert while it
+//   checks that its key is new and adds the tuple
+// scans don't take the split latch; see readBucket()
+#define SPLITLATCH  (1<<20)
+#define HEADERLATCH (SPLITLATCH+1)
+#define SWAPLATCH   (SPLITLATCH+2)
+#define KEYLATCH    (SPLITLATCH+16)
+#define KEYLATCHES  1024
+
+// copyRelation() holds about this many bytes of tuples in
+// memory before writing them out to their buckets
+#define COPYBATCH (4*1024*1024)
+
+// logged inserts (see logRelation()) commit after this many
+// tuples or changed pages, whichever comes first, and
+// checkpoint once the log grows past WALCHECKPOINT bytes
+#define WALGROUP      256
+#define WALMAXDIRTY   512
+#define WALCHECKPOINT (8*1024*1024)
 
 void freeBackup( char **backup, int how_many_tuples );
 void BackTuple( char **backup, int how_many_existing_tuples, char *start, char *end );
@@ -22,6 +70,48 @@ void Display( Reln _r );
 void SplitPage( Reln _r );
 void collectEmptyPage( Reln _r );
 void Store_And_insert_agian( FILE *_handler, PageID _pid, Reln _r );
+static PageID addToBucket(Reln r, Tuple t, PageID p);
+static PageID allocOvflowPage(Reln r);
+static void readHeader(Reln r);
+static void readHeaderInto(Reln r, struct RelnRep *h);
+static void snapshotHeader(Reln r, struct RelnRep *h);
+static void writeHeader(Reln r);
+static void splitBucket(Reln r);
+static void saveShadow(Reln r, PageID s);
+static Count readChain(FILE *f, FILE *ovf, PageID p, Page **pages, PageID **pids, Count n);
+static Count readChainMatching(Reln r, PageID p, ValueProbe *probe, Page **pages, Count n);
+static void freeOvflowPage(Reln r, PageID pid);
+static void mergeBucket(Reln r);
+static void splitInPlace(Reln r, PageID b);
+static void putChain(Reln r, PageID p, char **tuples, Count n, PageID *spare, Count *nspare);
+static PageID routeTo(Count depth, Offset sp, Bits h);
+static void dropStrangers(Reln r, Page *pages, Count n, PageID b, Count bits);
+static void recoverRelation(char *name);
+static Bool replaced(FILE *f);
+static void reopenRelation(Reln r);
+static void flushCopy(Reln n, char ***pending, Count *npending);
+static void syncRelation(Reln r);
+static void noteValues(Reln r, Tuple t);
+static void saveStats(Reln r);
+static Bool keyTaken(Reln r, Tuple t, Offset *latch);
+static void readBloom(Reln r, FILE *f, PageID pid, Byte *rec);
+static void writeBloom(Reln r, FILE *f, PageID pid, Byte *rec);
+static void addToBloom(Reln r, FILE *f, PageID pid, Tuple t);
+static void rebuildBloom(Reln r, FILE *f, PageID pid, Page pg);
+static void rebuildBucketBloom(Reln r, PageID b);
+static Bool pageMayMatch(Reln r, FILE *f, PageID pid, ValueProbe *probe);
+static void openIndexes(Reln r);
+static void closeIndexes(Reln r);
+static void indexTuple(Reln r, Tuple t, Bits h);
+static Bits layoutStamp(Reln r);
+static int byPair(const void *a, const void *b);
+static int loggedFiles(Reln r);
+static void readSig(Reln r, PageID b, Byte *rec);
+static void writeSig(Reln r, PageID b, Byte *rec);
+static void signTuple(Reln r, Byte *rec, char *t);
+static void addToSignature(Reln r, PageID b, Tuple t);
+static void rebuildSig(Reln r, PageID b, Page *pages, Count n);
+static void rebuildBucketSig(Reln r, PageID b);
 
 int int_pow(int base, int exp)
 {
@@ -63,8 +153,20 @@ struct RelnRep {
 	 * }
 	 */
 	PageID first_empty_page;
+	Count  hashfn; // which hash function (HASH_* in hash.h)
+	Count  gen;    // #splits committed; changes whenever depth/sp do
+	PageID splitting; // bucket being split (old image in .shadow), or NO_PAGE
+	Count  expect; // presized for this many tuples; no splits until then
+	Count  minpages; // merges don't go below this many buckets
+	Bits   key;    // attributes of the unique key (bit i for attr i), or 0
+	Count  indexes; // bumped whenever an index is built or dropped
+	Count  version; // RELNVERSION
 
 	ChVec  cv;     // choice vector
+	OrderSpec order; // order-preserving attributes (after cv in R.info)
+	HashFn hash;   // hashfn looked up in hash.c's table
+	ChVecPlan plan; // cv compiled for gathering hash bits
+	HashMemo memo; // remembered value hashes (NULL if not used)
 	/**
 	 * r means read only
 	 * w means need to write before close
@@ -73,18 +175,57 @@ struct RelnRep {
 	FILE  *info;   // handle on info file
 	FILE  *data;   // handle on data file
 	FILE  *ovflow; // handle on ovflow file
+	FILE  *shadow; // handle on shadow file (bucket being split)
+	FILE  *bloom;  // handle on bloom file (NULL if there isn't one)
+	FILE  *sig;    // handle on signature file (NULL if there isn't one)
+	Count  sigwidth, sigk; // from its header (see sig.h)
+	int    splitmode; // split latch held (LOCK_*), or -1 if none
+	FILE  *log;    // handle on wal file (NULL if there isn't one)
+	Wal    wal;    // log of changes since last commit (NULL if not logging)
+	Count  logged; // #tuples added since last commit
+	char   name[MAXRELNAME+1]; // as given to openRelation()
+	Count  opens;  // #times reopened after replaceRelation()
+	Count  added;  // tuples we've inserted that ntups doesn't count yet
+	Count  seen;   // indexes as of our last look for index files
+	AttrStats *stats; // values added since opened (NULL if none)
+	BTree  idx[MAXATTRS]; // index on each attribute (NULL if none)
+	BitmapIndex bmp[MAXATTRS]; // bitmap index on each (NULL if none)
 };
 
 // create a new relation (three files)
 
-Status newRelation(char *name, Count nattrs, Count npages, Count d, char *cv)
+// npages = 2^d + sp primary pages, i.e. as if sp buckets had
+// already been split; expect is the #tuples it's sized for
+// (0 if not presized); merges never take it below npages
+// key is the set of attributes no two tuples may share values
+// for (bit i for attribute i), or 0 if there's no key
+// order gives the attributes hashed by orderHash() rather than
+//   hf, and their ranges (NULL if there are none)
+
+Status newRelation(char *name, Count nattrs, Count npages, Count d, Count sp, char *cv, Count hf, Count expect, Bits key, OrderSpec *order)
 {
     char fname[MAXFILENAME];
+	if (npages != (1u << d) + sp || sp >= (1u << d)) return ~OK;
+	if (key >= (1u << nattrs)) return ~OK;
 	Reln r = malloc(sizeof(struct RelnRep));
-	r->nattrs = nattrs; r->depth = d; r->sp = 0;
-	r->npages = npages; r->ntups = 0; r->mode = 'w'; r->first_empty_page = NO_PAGE;
 	assert(r != NULL);
+	r->nattrs = nattrs; r->depth = d; r->sp = sp; r->expect = expect;
+	r->minpages = npages;
+	r->npages = npages; r->ntups = 0; r->mode = 'w'; r->first_empty_page = NO_PAGE;
+	r->gen = 0; r->splitting = NO_PAGE; r->wal = NULL; r->stats = NULL;
+	memset(r->idx, 0, sizeof(r->idx));
+	memset(r->bmp, 0, sizeof(r->bmp));
+	r->key = key;  r->indexes = 0;  r->added = 0;
+	r->version = RELNVERSION;
+	memset(&r->order, 0, sizeof(OrderSpec));
+	if (order != NULL) r->order = *order;
+	if (r->order.attrs >= (1u << nattrs)) return ~OK;
+	for (Count i = 0; i < nattrs; i++)
+		if (bitAt(r->order.attrs, i) && r->order.lo[i] > r->order.hi[i]) return ~OK;
+	if (hf >= NHASHFNS) return ~OK;
+	r->hashfn = hf; r->hash = hashFunction(hf); r->memo = NULL;
 	if (parseChVec(r, cv, r->cv) != OK) return ~OK;
+	compileChVec(r->cv, r->nattrs, &r->plan);
 	sprintf(fname,"%s.info",name);
 	r->info = fopen(fname,"w");
 	assert(r->info != NULL);
@@ -94,9 +235,25 @@ Status newRelation(char *name, Count nattrs, Count npages, Count d, char *cv)
 	sprintf(fname,"%s.ovflow",name);
 	r->ovflow = fopen(fname,"w");
 	assert(r->ovflow != NULL);
+	sprintf(fname,"%s.shadow",name);
+	r->shadow = fopen(fname,"w");
+	assert(r->shadow != NULL);
+	sprintf(fname,"%s.wal",name);
+	r->log = fopen(fname,"w");
+	assert(r->log != NULL);
+	sprintf(fname,"%s.bloom",name);
+	r->bloom = fopen(fname,"w");
+	assert(r->bloom != NULL);
+	// signatures are added later, if wanted (see addSignatures())
+	r->sig = NULL;
 	int i;
 	for (i = 0; i < npages; i++) addPage(r->data);
-	// closeRelation() writes global info
+	writeHeader(r);
+	fseek(r->info, HEADERCOUNTS*sizeof(Count), SEEK_SET);
+	int n = fwrite(r->cv, sizeof(ChVecItem), MAXCHVEC, r->info);
+	assert(n == MAXCHVEC);
+	n = fwrite(&r->order, sizeof(OrderSpec), 1, r->info);
+	assert(n == 1);
 	closeRelation(r);
 	return 0;
 }
@@ -122,49 +279,531 @@ Bool existsRelation(char *name)
 Reln openRelation(char *name, char *mode)
 {
 	Reln r;
+	recoverRelation(name);
 	r = malloc(sizeof(struct RelnRep));
 	assert(r != NULL);
 	char fname[MAXFILENAME];
 	sprintf(fname,"%s.info",name);
-	r->info = fopen(fname,mode);
-	assert(r->info != NULL);
+	// if replaceRelation() is moving new files into place, wait,
+	//   then start again with the new .info
+	for (;;) {
+		r->info = fopen(fname,mode);
+		assert(r->info != NULL);
+		lockRange(r->info, SWAPLATCH, 1, LOCK_SHARED, TRUE);
+		if (!replaced(r->info)) break;
+		fclose(r->info);
+	}
+	// one made by another version (e.g. with a shorter header, and
+	//   no .shadow) gets an error, not asserts or a misread header
+	Count version = 0;
+	ssize_t n = pread(fileno(r->info), &version, sizeof(Count),
+	                  offsetof(struct RelnRep, version));
+	if (n != sizeof(Count) || version != RELNVERSION) {
+		fprintf(stderr, "%s was made by another version of this program; "
+		                "create it again\n", name);
+		fclose(r->info);
+		free(r);
+		return NULL;
+	}
 	sprintf(fname,"%s.data",name);
 	r->data = fopen(fname,mode);
 	assert(r->data != NULL);
 	sprintf(fname,"%s.ovflow",name);
 	r->ovflow = fopen(fname,mode);
 	assert(r->ovflow != NULL);
-	// Naughty: assumes Count and Offset are the same size
-	int n = fread(r, sizeof(Count), 6, r->info);
-	assert(n == 6);
+	sprintf(fname,"%s.shadow",name);
+	r->shadow = fopen(fname,mode);
+	assert(r->shadow != NULL);
+	// other processes may be changing the files, so don't
+	//   let stdio hold stale (or unwritten) copies of pages
+	setvbuf(r->info, NULL, _IONBF, 0);
+	setvbuf(r->data, NULL, _IONBF, 0);
+	setvbuf(r->ovflow, NULL, _IONBF, 0);
+	setvbuf(r->shadow, NULL, _IONBF, 0);
+	// relations made before logging existed have no .wal
+	sprintf(fname,"%s.wal",name);
+	r->log = fopen(fname,mode);
+	// nor .bloom; their pages are then never skipped
+	sprintf(fname,"%s.bloom",name);
+	r->bloom = fopen(fname,mode);
+	if (r->bloom != NULL) setvbuf(r->bloom, NULL, _IONBF, 0);
+	// and only some have a .sig
+	sprintf(fname,"%s.sig",name);
+	r->sig = fopen(fname,mode);
+	r->sigwidth = r->sigk = 0;
+	if (r->sig != NULL) {
+		SigHeader h;
+		setvbuf(r->sig, NULL, _IONBF, 0);
+		if (fread(&h, sizeof(SigHeader), 1, r->sig) == 1 && h.magic == SIGMAGIC) {
+			r->sigwidth = h.width;
+			r->sigk = h.k;
+		}
+		else {
+			fclose(r->sig);
+			r->sig = NULL;
+		}
+	}
+	unlockRange(r->info, SWAPLATCH, 1);
+	strcpy(r->name, name);
+	r->opens = 0;
+	r->added = 0;
+	r->stats = NULL;
+	memset(r->idx, 0, sizeof(r->idx));
+	memset(r->bmp, 0, sizeof(r->bmp));
+	r->splitmode = -1;
+	r->wal = NULL;
+	refreshRelation(r);
+	fseek(r->info, HEADERCOUNTS*sizeof(Count), SEEK_SET);
 	n = fread(r->cv, sizeof(ChVecItem), MAXCHVEC, r->info);
 	assert(n == MAXCHVEC);
+	// relations made before order-preserving attributes have none
+	if (fread(&r->order, sizeof(OrderSpec), 1, r->info) != 1)
+		memset(&r->order, 0, sizeof(OrderSpec));
+	r->hash = hashFunction(r->hashfn);
+	compileChVec(r->cv, r->nattrs, &r->plan);
+	r->memo = NULL;
 	r->mode = (mode[0] == 'w' || mode[1] =='+') ? 'w' : 'r';
+	openIndexes(r);
 	return r;
 }
 
+// read/write core relation info (#attr,d,sp,#pages,...,hashfn)
+// Naughty: assumes Count and Offset are the same size
+// the header, pages, Bloom filters and signatures are read and
+//   written with pread()/pwrite(), one syscall each, on files
+//   that stdio doesn't buffer (see openRelation()), so anything
+//   read after them with stdio has to seek first
+
+static void readHeader(Reln r)
+{
+	readHeaderInto(r, r);
+}
+
+static void readHeaderInto(Reln r, struct RelnRep *h)
+{
+	ssize_t n = pread(fileno(r->info), h, HEADERCOUNTS*sizeof(Count), 0);
+	assert(n == HEADERCOUNTS*sizeof(Count));
+}
+
+// latest header, as written by any process, without changing r
+
+static void snapshotHeader(Reln r, struct RelnRep *h)
+{
+	lockRange(r->info, HEADERLATCH, 1, LOCK_SHARED, TRUE);
+	readHeaderInto(r, h);
+	unlockRange(r->info, HEADERLATCH, 1);
+}
+
+static void writeHeader(Reln r)
+{
+	if (r->wal != NULL) {
+		walPutBytes(r->wal, r->info, 0, r, HEADERCOUNTS*sizeof(Count));
+		return;
+	}
+	ssize_t n = pwrite(fileno(r->info), r, HEADERCOUNTS*sizeof(Count), 0);
+	assert(n == HEADERCOUNTS*sizeof(Count));
+}
+
+// get the latest header, as written by any process
+// scans use r's copy as their snapshot of depth and sp
+
+void refreshRelation(Reln r)
+{
+	snapshotHeader(r, r);
+}
+
+// take the split latch; depth and sp stay fixed until it's
+// released, and in exclusive mode nobody else can use the file
+
+void latchSplit(Reln r, int mode)
+{
+	lockRange(r->info, SPLITLATCH, 1, mode, TRUE);
+	// a writer that opened r before replaceRelation() put a new
+	//   version in its place moves on to the new one
+	while (r->mode == 'w' && replaced(r->info)) {
+		reopenRelation(r);
+		lockRange(r->info, SPLITLATCH, 1, mode, TRUE);
+	}
+	r->splitmode = mode;
+	// a logging writer holds the latch until it closes, so a log
+	// with something in it now was left by one that died; redo it
+	// before anyone else changes pages it may have half written
+	if (r->wal == NULL && r->mode == 'w' && walPending(r->log)) {
+		if (mode != LOCK_EXCL) {
+			unlockRange(r->info, SPLITLATCH, 1);
+			lockRange(r->info, SPLITLATCH, 1, LOCK_EXCL, TRUE);
+		}
+		FILE *files[] = { r->data, r->ovflow, r->info, r->bloom, r->sig };
+		if (walPending(r->log))
+			walRedo(r->log, files, loggedFiles(r));
+		if (mode != LOCK_EXCL)
+			lockRange(r->info, SPLITLATCH, 1, mode, TRUE);
+	}
+	// the fields the split latch guards (depth, sp, npages, gen,
+	//   indexes) can't change while we hold it, so this needs no
+	//   header latch; those that can (ntups, first_empty_page)
+	//   are read again under it before they're changed
+	readHeader(r);
+	// and to any index made (or dropped) since
+	if (r->mode == 'w' && r->indexes != r->seen) openIndexes(r);
+}
+
+// release the split latch, publishing the header if we
+// changed it while holding the latch exclusively
+
+void unlatchSplit(Reln r)
+{
+	if (r->splitmode == LOCK_EXCL) writeHeader(r);
+	unlockRange(r->info, SPLITLATCH, 1);
+	r->splitmode = -1;
+}
+
+void latchBucket(Reln r, PageID p, int mode)
+{
+	lockRange(r->data, p*PAGESIZE, PAGESIZE, mode, TRUE);
+}
+
+void unlatchBucket(Reln r, PageID p)
+{
+	unlockRange(r->data, p*PAGESIZE, PAGESIZE);
+}
+
+// get an overflow page, from the free list or the end of the file
+// both are shared by all buckets, so need the header latch
+//   (unless the split latch is already held exclusively)
+
+static PageID allocOvflowPage(Reln r)
+{
+	if (r->splitmode == LOCK_EXCL)
+		return addNewoverflowPage(r->ovflow, r);
+	lockRange(r->info, HEADERLATCH, 1, LOCK_EXCL, TRUE);
+	readHeader(r);
+	PageID pid = addNewoverflowPage(r->ovflow, r);
+	writeHeader(r);
+	unlockRange(r->info, HEADERLATCH, 1);
+	return pid;
+}
+
+// log all further changes to r in name.wal, and commit them in
+// groups; r is the only writer from now until closeRelation()
+// scans still run, and see the relation as of the last commit
+
+void logRelation(Reln r, char *name)
+{
+	char fname[MAXFILENAME];
+	latchSplit(r, LOCK_EXCL);
+	sprintf(fname,"%s.wal",name);
+	// order of files in the log; see recoverRelation()
+	FILE *files[] = { r->data, r->ovflow, r->info, r->bloom, r->sig };
+	r->wal = openWal(fname, files, loggedFiles(r));
+	r->logged = 0;
+	// in case we just redid a log left by a dead writer
+	readHeader(r);
+	r->ntups += r->added;
+	r->added = 0;
+}
+
+// #files (from the start of the order above) that r has;
+// .bloom comes before .sig, which is only added if there's one
+
+static int loggedFiles(Reln r)
+{
+	if (r->bloom == NULL) return 3;
+	return (r->sig == NULL) ? 4 : 5;
+}
+
+// group commit: log everything changed since the last commit
+// (one fsync), then write it to the relation's files while no
+// scan is reading any bucket
+
+void commitRelation(Reln r)
+{
+	if (r->wal == NULL || walDirty(r->wal) == 0) return;
+	walLog(r->wal);
+	lockRange(r->data, 0, 0, LOCK_EXCL, TRUE);
+	lockRange(r->info, HEADERLATCH, 1, LOCK_EXCL, TRUE);
+	walApply(r->wal);
+	unlockRange(r->info, HEADERLATCH, 1);
+	unlockRange(r->data, 0, 0);
+	r->logged = 0;
+	if (walSize(r->wal) > WALCHECKPOINT) walCheckpoint(r->wal);
+}
+
+// if a logged insert died, redo the groups it committed, so
+// even read-only users see them (unless the relation is busy,
+// in which case the next latchSplit() by a writer will do it)
+// done before opening r's own handles, since closing any file
+//   releases all of this process's locks on it
+
+static void recoverRelation(char *name)
+{
+	char fname[MAXFILENAME];
+	sprintf(fname,"%s.wal",name);
+	FILE *log = fopen(fname,"r+");
+	if (log == NULL) return;
+	if (!walPending(log)) {
+		fclose(log);
+		return;
+	}
+
+	FILE *files[5];
+	sprintf(fname,"%s.data",name);
+	files[0] = fopen(fname,"r+");
+	sprintf(fname,"%s.ovflow",name);
+	files[1] = fopen(fname,"r+");
+	sprintf(fname,"%s.info",name);
+	files[2] = fopen(fname,"r+");
+	sprintf(fname,"%s.bloom",name);
+	files[3] = fopen(fname,"r+");
+	sprintf(fname,"%s.sig",name);
+	files[4] = (files[3] != NULL) ? fopen(fname,"r+") : NULL;
+	int nfiles = (files[3] == NULL) ? 3 : (files[4] == NULL) ? 4 : 5;
+	if (files[0] != NULL && files[1] != NULL && files[2] != NULL
+	    && lockRange(files[2], SPLITLATCH, 1, LOCK_EXCL, FALSE) == OK)
+		walRedo(log, files, nfiles);
+	for (int i = 0; i < 5; i++)
+		if (files[i] != NULL) fclose(files[i]);
+	fclose(log);
+}
+
 // release files and descriptor for an open relation
-// copy latest information to .info file
+// the header is already up to date in .info
 
 void closeRelation(Reln r)
 {
-	// make sure updated global data is put in info
-	// Naughty: assumes Count and Offset are the same size
-	if (r->mode == 'w') {
-		fseek(r->info, 0, SEEK_SET);
-		// write out core relation info (#attr,#pages,d,sp)
-		int n = fwrite(r, sizeof(Count), 6, r->info);
-		assert(n == 6);
-		// write out choice vector
-		n = fwrite(r->cv, sizeof(ChVecItem), MAXCHVEC, r->info);
-		assert(n == MAXCHVEC);
+	// inserts not yet counted in the header (see addToRelation());
+	//   ntups only changes under the split latch and header latch
+	if (r->added > 0) {
+		latchSplit(r, LOCK_SHARED);
+		lockRange(r->info, HEADERLATCH, 1, LOCK_EXCL, TRUE);
+		readHeader(r);
+		r->ntups += r->added;
+		r->added = 0;
+		writeHeader(r);
+		unlockRange(r->info, HEADERLATCH, 1);
+		unlatchSplit(r);
+	}
+	if (r->wal != NULL) {
+		commitRelation(r);
+		walCheckpoint(r->wal);
+		closeWal(r->wal);
+		r->wal = NULL;
+		unlatchSplit(r);
 	}
 	fclose(r->info);
 	fclose(r->data);
 	fclose(r->ovflow);
+	fclose(r->shadow);
+	if (r->log != NULL) fclose(r->log);
+	if (r->bloom != NULL) fclose(r->bloom);
+	if (r->sig != NULL) fclose(r->sig);
+	closeIndexes(r);
+	freeChVecPlan(&r->plan);
+	if (r->memo != NULL) freeHashMemo(r->memo);
+	if (r->stats != NULL) {
+		saveStats(r);
+		free(r->stats);
+	}
 	free(r);
 }
 
+// has the file behind f been replaced (renamed over)?
+
+static Bool replaced(FILE *f)
+{
+	struct stat st;
+	int ok = fstat(fileno(f), &st);
+	assert(ok == 0);
+	return st.st_nlink == 0;
+}
+
+// close r's files and open the version now under its name,
+// keeping the memo of value hashes (which don't depend on cv)
+// closing .info releases all our latches on the old version
+
+static void reopenRelation(Reln r)
+{
+	Reln n = openRelation(r->name, "r+");
+	fclose(r->info);
+	fclose(r->data);
+	fclose(r->ovflow);
+	fclose(r->shadow);
+	if (r->log != NULL) fclose(r->log);
+	if (r->bloom != NULL) fclose(r->bloom);
+	if (r->sig != NULL) fclose(r->sig);
+	closeIndexes(r);
+	freeChVecPlan(&r->plan);
+	HashMemo memo = r->memo;
+	AttrStats *stats = r->stats;
+	Count opens = r->opens;
+	*r = *n;
+	r->memo = memo;
+	r->stats = stats;
+	r->opens = opens+1;
+	free(n);
+}
+
+// make a relation called name with the same buckets as r, but
+// choice vector cv, and load all of r's live tuples into it
+// r is read bucket by bucket; tuples are gathered per new bucket
+//   until COPYBATCH bytes are held, then each bucket that has
+//   some gets them all in one go, in bucket order
+// caller holds r's split latch exclusively, so scans of r carry
+//   on, but nothing changes it; returns ~OK if cv is invalid
+
+Status copyRelation(Reln r, char *name, char *cv)
+{
+	if (newRelation(name, r->nattrs, r->npages, r->depth, r->sp,
+	                cv, r->hashfn, r->expect, r->key, &r->order) != OK)
+		return ~OK;
+	Reln n = openRelation(name, "r+");
+	assert(n != NULL);
+	latchSplit(n, LOCK_EXCL);
+	n->ntups = r->ntups;
+	n->minpages = r->minpages;
+	// and signatures, filled in as the tuples go in
+	if (r->sig != NULL) {
+		Status ok = addSignatures(n, r->sigwidth, r->sigk);
+		assert(ok == OK);
+	}
+	// with the same indexes, for its hashes
+	for (Count a = 0; a < r->nattrs; a++) {
+		if (r->idx[a] == NULL) continue;
+		char fname[MAXFILENAME];
+		sprintf(fname,"%s.idx.%d",name,a);
+		if (n->idx[a] != NULL) closeBTree(n->idx[a]);
+		n->idx[a] = newBTree(fname, layoutStamp(n));
+		assert(n->idx[a] != NULL);
+	}
+
+	char ***pending = calloc(n->npages, sizeof(char **));
+	Count *npending = calloc(n->npages, sizeof(Count));
+	assert(pending != NULL && npending != NULL);
+	Count held = 0;
+	for (PageID b = 0; b < r->npages; b++) {
+		Page *pages;  PageID *pids;
+		Count np = getBucket(r, b, &pages, &pids);
+		for (Count i = 0; i < np; i++) {
+			char *t = pageData(pages[i]);
+			for (Count j = 0; j < pageNTuples(pages[i]); j++, t += strlen(t)+1) {
+				if (t[0] == TOMBSTONE) continue;
+				Bits h = tupleHashQuiet(n, t);
+				PageID p = routeTo(n->depth, n->sp, h);
+				indexTuple(n, t, h);
+				pending[p] = realloc(pending[p], (npending[p]+1)*sizeof(char *));
+				assert(pending[p] != NULL);
+				char *copy = malloc(strlen(t)+1);
+				assert(copy != NULL);
+				strcpy(copy, t);
+				pending[p][npending[p]++] = copy;
+				held += strlen(t)+1;
+			}
+			free(pages[i]);
+		}
+		free(pages);  free(pids);
+		if (held >= COPYBATCH) {
+			flushCopy(n, pending, npending);
+			held = 0;
+		}
+	}
+	flushCopy(n, pending, npending);
+	free(pending);  free(npending);
+	// bitmap indexes are built in one go, rather than added to
+	for (Count a = 0; a < r->nattrs; a++)
+		if (r->bmp[a] != NULL) buildBitmap(n, a);
+
+	unlatchSplit(n);
+	syncRelation(n);
+	closeRelation(n);
+	return OK;
+}
+
+// add the tuples gathered for each bucket of n to its chain
+
+static void flushCopy(Reln n, char ***pending, Count *npending)
+{
+	for (PageID p = 0; p < n->npages; p++) {
+		if (npending[p] == 0) continue;
+		Page *pages;  PageID *pids;
+		Count np = getBucket(n, p, &pages, &pids);
+		Count nt = npending[p];
+		for (Count i = 0; i < np; i++) nt += pageNTuples(pages[i]);
+		char **all = malloc(nt*sizeof(char *));
+		assert(all != NULL);
+		Count k = 0;
+		for (Count i = 0; i < np; i++) {
+			char *t = pageData(pages[i]);
+			for (Count j = 0; j < pageNTuples(pages[i]); j++, t += strlen(t)+1)
+				all[k++] = t;
+		}
+		for (Count i = 0; i < npending[p]; i++) all[k++] = pending[p][i];
+		// the chain only grows, so all of its pages are reused
+		Count nspare = np-1;
+		putChain(n, p, all, k, pids+1, &nspare);
+		assert(nspare == 0);
+
+		for (Count i = 0; i < np; i++) free(pages[i]);
+		for (Count i = 0; i < npending[p]; i++) free(pending[p][i]);
+		free(pages);  free(pids);  free(all);
+		free(pending[p]);
+		pending[p] = NULL;
+		npending[p] = 0;
+	}
+}
+
+// move the files of relation name (e.g. made by copyRelation())
+// over r's; new opens wait until all of them are in place, and
+//   then get the new version, as do writers that already have r
+//   open, the next time they take its split latch
+// scans that already have r open finish on the old version
+// caller holds r's split latch exclusively
+// .info goes last, so anyone who gets the new .info gets the
+//   new version of everything else too
+
+void replaceRelation(Reln r, char *name)
+{
+	char *suffix[] = { "data", "ovflow", "shadow", "wal", "bloom", "sig", "info" };
+	char from[MAXFILENAME], to[MAXFILENAME];
+	lockRange(r->info, SWAPLATCH, 1, LOCK_EXCL, TRUE);
+	for (int i = 0; i < 7; i++) {
+		// and its indexes, which it may not have
+		if (strcmp(suffix[i], "info") == 0) {
+			for (Count a = 0; a < 2*r->nattrs; a++) {
+				char *kind = (a < r->nattrs) ? "idx" : "bmp";
+				sprintf(from,"%s.%s.%d",name,kind,a % r->nattrs);
+				sprintf(to,"%s.%s.%d",r->name,kind,a % r->nattrs);
+				if (access(from, F_OK) == 0) {
+					int ok = rename(from, to);
+					assert(ok == 0);
+				}
+			}
+		}
+		sprintf(from,"%s.%s",name,suffix[i]);
+		sprintf(to,"%s.%s",r->name,suffix[i]);
+		// a .sig goes with the version that has one
+		if (strcmp(suffix[i], "sig") == 0 && access(from, F_OK) != 0) {
+			unlink(to);
+			continue;
+		}
+		int ok = rename(from, to);
+		assert(ok == 0);
+	}
+	unlockRange(r->info, SWAPLATCH, 1);
+}
+
+// make r's files durable
+
+static void syncRelation(Reln r)
+{
+	FILE *files[] = { r->info, r->data, r->ovflow, r->bloom, r->sig };
+	for (int i = 0; i < 5; i++) {
+		if (files[i] == NULL) continue;
+		fflush(files[i]);
+		int ok = fsync(fileno(files[i]));
+		assert(ok == 0);
+	}
+}
+
 
 /**
  * after splitting is done, need to check if there is any empty overflow page , and collect them
@@ -303,11 +942,15 @@ void Store_And_insert_agian( FILE *_handler, PageID _pid, Reln _r )
 	// after store
 	// reset this page's 3 members, the last one data[1] should be same
 	// reset the tuple parts
-	_r->ntups = _r->ntups - how_many_tuples_curr_page;
+	// deleted tuples are already out of ntups, and are dropped here
+	for( int i = 0 ; i < how_many_tuples_curr_page ; i++ ) {
+		if( backup[ i ][ 0 ] != TOMBSTONE ) _r->ntups--;
+	}
 	resetPageInfo( _handler, _pid, curr_page );
 
 	// insert again, except this time you use one more bit of hash value
 	for( int i = 0 ; i < how_many_tuples_curr_page ; i++ ) {
+		if( backup[ i ][ 0 ] == TOMBSTONE ) continue;
 		addToRelationSplitVersion( _r, backup[ i ] );
 	}
 	// free char **backup, curr_page
@@ -364,6 +1007,590 @@ void SplitPage( Reln _r )
 	}
 }
 
+// split bucket sp, keeping its old image in .shadow until the
+// split commits, so scans that reach it never have to wait
+// caller holds the split latch exclusively
+
+static void splitBucket(Reln r)
+{
+	PageID s = r->sp;
+	PageID img = (1u << r->depth) + s;
+
+	saveShadow(r, s);
+	lockRange(r->info, HEADERLATCH, 1, LOCK_EXCL, TRUE);
+	r->splitting = s;
+	writeHeader(r);
+	unlockRange(r->info, HEADERLATCH, 1);
+
+	// waits for scans already reading bucket s
+	latchBucket(r, s, LOCK_EXCL);
+	latchBucket(r, img, LOCK_EXCL);
+	SplitPage(r);
+	rebuildBucketBloom(r, s);
+	rebuildBucketBloom(r, img);
+	// img's first, so a scan of R.sig always finds s's tuples in one
+	rebuildBucketSig(r, img);
+	rebuildBucketSig(r, s);
+
+	// commit: new depth, sp and gen become visible together
+	lockRange(r->info, HEADERLATCH, 1, LOCK_EXCL, TRUE);
+	r->splitting = NO_PAGE;
+	r->gen++;
+	writeHeader(r);
+	unlockRange(r->info, HEADERLATCH, 1);
+	unlatchBucket(r, img);
+	unlatchBucket(r, s);
+}
+
+// copy the chain of bucket s to .shadow as pages 0,1,2,...
+// after waiting for scans still reading the previous copy
+
+static void saveShadow(Reln r, PageID s)
+{
+	lockRange(r->shadow, 0, 0, LOCK_EXCL, TRUE);
+	PageID pid = 0;
+	Page pg = getPage(r->data, s);
+	for (;;) {
+		PageID next = pageOvflow(pg);
+		pageSetOvflow(pg, (next == NO_PAGE) ? NO_PAGE : pid+1);
+		putPage(r->shadow, pid, pg);
+		if (next == NO_PAGE) break;
+		pg = getPage(r->ovflow, next);
+		pid++;
+	}
+	unlockRange(r->shadow, 0, 0);
+}
+
+// append the pages of the chain starting at page p of f
+// (overflow pages in ovf) to *pages, which holds n already,
+// and their ids to *pids (unless pids is NULL)
+
+static Count readChain(FILE *f, FILE *ovf, PageID p, Page **pages, PageID **pids, Count n)
+{
+	while (p != NO_PAGE) {
+		*pages = realloc(*pages, (n+1)*sizeof(Page));
+		assert(*pages != NULL);
+		if (pids != NULL) {
+			*pids = realloc(*pids, (n+1)*sizeof(PageID));
+			assert(*pids != NULL);
+			(*pids)[n] = p;
+		}
+		Page pg = getPage(f, p);
+		(*pages)[n++] = pg;
+		p = pageOvflow(pg);
+		f = ovf;
+	}
+	return n;
+}
+
+// as for readChain() on the chain of bucket p, but leaving out
+// pages whose filters say they hold no tuple matching probe
+// (only their headers are read, to follow the chain)
+
+static Count readChainMatching(Reln r, PageID p, ValueProbe *probe, Page **pages, Count n)
+{
+	FILE *f = r->data;
+	while (p != NO_PAGE) {
+		if (pageMayMatch(r, f, p, probe)) {
+			*pages = realloc(*pages, (n+1)*sizeof(Page));
+			assert(*pages != NULL);
+			Page pg = getPage(f, p);
+			(*pages)[n++] = pg;
+			p = pageOvflow(pg);
+		}
+		else {
+			Page hd = getPageCertainInfo(f, p);
+			p = pageOvflow(hd);
+			free(hd);
+		}
+		f = r->ovflow;
+	}
+	return n;
+}
+
+// read the pages holding every tuple that was in bucket b when
+// b was addressed by the lower 'bits' bits of the hash
+// - if b has been split since then, that's b and all of its
+//   descendants, b + k*2^bits, as they are now
+// - if one of them is being split now, its old image is read
+//   from .shadow instead, so we never wait for a split
+// - if b has been merged since, it's the bucket b's tuples now
+//   route to, less the tuples from b's buddy (marked as deleted)
+// either way, all of them are read at the same generation
+// returns the #pages, in *pages (caller frees both)
+
+Count readBucket(Reln r, PageID b, Count bits, Page **pages)
+{
+	return readBucketMatching(r, b, bits, NULL, pages);
+}
+
+// as for readBucket(), but pages that can't hold a tuple with
+// the values in probe (by their Bloom filters) may be left out
+// (an old image in .shadow is always read in full)
+
+Count readBucketMatching(Reln r, PageID b, Count bits, ValueProbe *probe, Page **pages)
+{
+	struct RelnRep h, now;
+	for (;;) {
+		snapshotHeader(r, &h);
+		Count nb = (1u << h.depth) + h.sp;
+		PageID first = b, c;
+		Offset step = 1u << bits;
+		Bool inShadow = FALSE, mixed = FALSE;
+		if (bits > h.depth) {
+			// maybe merged, so just the one bucket, which may
+			//   hold tuples from b's buddy too
+			first = routeTo(h.depth, h.sp, b);
+			step = nb;
+			Bool split = first < h.sp || first >= (1u << h.depth);
+			mixed = (split ? h.depth+1 : h.depth) < bits;
+		}
+
+		// latch the family in ascending order
+		for (c = first; c < nb; c += step) {
+			if (c == h.splitting) { inShadow = TRUE; continue; }
+			if (lockRange(r->data, c*PAGESIZE, PAGESIZE,
+			              LOCK_SHARED, FALSE) == OK) continue;
+			// an insert holds c, unless a split began on c
+			// since the snapshot; only wait for the insert
+			snapshotHeader(r, &now);
+			if (now.gen != h.gen || now.splitting != h.splitting) break;
+			latchBucket(r, c, LOCK_SHARED);
+		}
+		if (c < nb) {
+			// release the ones we got, and start again
+			for (PageID u = first; u < c; u += step)
+				if (u != h.splitting) unlatchBucket(r, u);
+			continue;
+		}
+		Bool ok = !inShadow ||
+		          lockRange(r->shadow, 0, 0, LOCK_SHARED, FALSE) == OK;
+
+		// family is fixed now, but a split may have committed
+		//   between the snapshot and getting the latches
+		snapshotHeader(r, &now);
+		ok = ok && now.gen == h.gen;
+
+		Count n = 0;
+		*pages = NULL;
+		for (c = first; c < nb; c += step) {
+			if (c == h.splitting) {
+				if (ok) n = readChain(r->shadow, r->shadow, 0, pages, NULL, n);
+				continue;
+			}
+			if (ok && probe != NULL)
+				n = readChainMatching(r, c, probe, pages, n);
+			else if (ok)
+				n = readChain(r->data, r->ovflow, c, pages, NULL, n);
+			unlatchBucket(r, c);
+		}
+		if (inShadow) unlockRange(r->shadow, 0, 0);
+		if (ok) {
+			if (mixed) dropStrangers(r, *pages, n, b, bits);
+			return n;
+		}
+		free(*pages);
+	}
+}
+
+// next bucket after b whose hash bits agree with the bits of
+// known at the positions in knownPos, or the first such bucket
+// if b is NO_PAGE; NO_PAGE when none are left
+// buckets come out in increasing order:
+// 1. 0 .. 2^d-1, stepping straight over non-matching ones with
+//    nextAgreeing(); buckets below sp are already split, so
+//    only hold bit d == 0
+// 2. 2^d .. 2^d+sp-1, the split images, which hold bit d == 1
+
+PageID nextBucketAgreeing(Count depth, Offset sp, Bits known, Bits knownPos, PageID b)
+{
+	Bits top = 1u << depth;
+	Bits fixed = lowerBits(knownPos, depth);
+	Bits want = known & fixed;
+	Bool bitdKnown = bitAt(knownPos, depth);
+	int bitd = bitAt(known, depth);
+	Bits h;
+
+	if (b == NO_PAGE || b < top) {
+		h = (b == NO_PAGE) ? want : nextAgreeing(b, fixed, want);
+		for (; h < top; h = nextAgreeing(h, fixed, want)) {
+			if (h < sp && bitdKnown && bitd == 1) continue;
+			return h;
+		}
+		h = want;
+	}
+	else
+		h = nextAgreeing(b - top, fixed, want);
+	if (bitdKnown && bitd == 0) return NO_PAGE;
+	return (h < sp) ? h + top : NO_PAGE;
+}
+
+// bucket that hash h goes in, for a given depth and sp
+
+static PageID routeTo(Count depth, Offset sp, Bits h)
+{
+	PageID p = lowerBits(h, depth);
+	if (p < sp) p = lowerBits(h, depth+1);
+	return p;
+}
+
+// mark tuples in (copies of) pages that weren't in bucket b
+// at 'bits' bits as deleted, so the reader skips them
+
+static void dropStrangers(Reln r, Page *pages, Count n, PageID b, Count bits)
+{
+	for (Count i = 0; i < n; i++) {
+		char *t = pageData(pages[i]);
+		for (Count j = 0; j < pageNTuples(pages[i]); j++, t += strlen(t)+1) {
+			if (t[0] == TOMBSTONE) continue;
+			if (lowerBits(tupleHashQuiet(r, t), bits) != b) t[0] = TOMBSTONE;
+		}
+	}
+}
+
+// whether to split, now that C more tuples have been counted in
+// r's ntups: only once past r's presized size, and as long as
+// the file is still at least half full (by C tuples per bucket)
+//   after the split
+// shrinkRelation() only merges once it's under a quarter full,
+//   so a few deletes after a split don't undo it, and a few
+//   inserts after a merge don't redo it
+
+static Bool splitDue(Reln r, Count C)
+{
+	return r->ntups > r->expect && 2*r->ntups >= C*(r->npages+1);
+}
+
+// undo splits while the file is under a quarter full (see
+// splitDue()), down to the size it was created (or grown) with
+// returns #buckets merged
+
+Count shrinkRelation(Reln r)
+{
+	Count C = 1024/(10*r->nattrs);
+	Count nmerged = 0;
+	refreshRelation(r);
+	if (r->npages <= r->minpages || 4*r->ntups >= C*r->npages) return 0;
+	latchSplit(r, LOCK_EXCL);
+	while (r->npages > r->minpages && 4*r->ntups < C*r->npages) {
+		mergeBucket(r);
+		nmerged++;
+	}
+	unlatchSplit(r);
+	return nmerged;
+}
+
+// the reverse of a split: move the tuples in the last bucket
+// (2^d+sp-1) into its buddy (sp-1), then drop it from the file
+// caller holds the split latch exclusively
+
+static void mergeBucket(Reln r)
+{
+	if (r->sp == 0) {
+		r->depth--;
+		r->sp = 1u << r->depth;
+	}
+	PageID buddy = r->sp - 1;
+	PageID last = (1u << r->depth) + r->sp - 1;
+	assert(last == r->npages - 1);
+
+	// waits for scans reading either of them
+	latchBucket(r, buddy, LOCK_EXCL);
+	latchBucket(r, last, LOCK_EXCL);
+	Page *pages;  PageID *pids;
+	Count n = getBucket(r, last, &pages, &pids);
+	for (Count i = 0; i < n; i++) {
+		char *t = pageData(pages[i]);
+		for (Count j = 0; j < pageNTuples(pages[i]); j++, t += strlen(t)+1) {
+			if (t[0] == TOMBSTONE) continue;
+			PageID p = addToBucket(r, t, buddy);
+			assert(p != NO_PAGE);
+		}
+		if (i > 0) freeOvflowPage(r, pids[i]);
+		free(pages[i]);
+	}
+	free(pages);  free(pids);
+	r->sp--;
+	r->npages--;
+	int ok = ftruncate(fileno(r->data), r->npages*PAGESIZE);
+	assert(ok == 0);
+
+	// commit: as for splitBucket()
+	lockRange(r->info, HEADERLATCH, 1, LOCK_EXCL, TRUE);
+	r->gen++;
+	writeHeader(r);
+	unlockRange(r->info, HEADERLATCH, 1);
+	unlatchBucket(r, last);
+	unlatchBucket(r, buddy);
+}
+
+// split buckets until there are (at least) npages of them,
+// all at once rather than one per C inserts
+// each round splits sp..2^d-1 (or as many as are still needed)
+//   in order, reading each chain once and appending its new
+//   image to the end of the data file, then advances sp and
+//   depth; the new depth and sp are committed in one step
+// like a presized file, it then won't split again until it
+//   holds as many tuples as the split rule would have grown
+//   it this far with, nor merge back below npages
+// returns #buckets added
+
+Count growRelation(Reln r, Count npages)
+{
+	Count C = 1024/(10*r->nattrs);
+	latchSplit(r, LOCK_EXCL);
+	Count before = r->npages;
+	if (npages <= r->npages) {
+		unlatchSplit(r);
+		return 0;
+	}
+	// scans wait until the whole file is consistent again
+	lockRange(r->data, 0, 0, LOCK_EXCL, TRUE);
+	while (r->npages < npages) {
+		Count top = 1u << r->depth;
+		PageID last = r->sp + (npages - r->npages);
+		if (last > top) last = top;
+		for (PageID b = r->sp; b < last; b++) splitInPlace(r, b);
+		r->npages += last - r->sp;
+		if (last == top) {
+			r->depth++;
+			r->sp = 0;
+		}
+		else
+			r->sp = last;
+	}
+	if (r->expect < npages*C) r->expect = npages*C;
+	if (r->minpages < npages) r->minpages = npages;
+
+	// commit: as for splitBucket()
+	lockRange(r->info, HEADERLATCH, 1, LOCK_EXCL, TRUE);
+	r->gen++;
+	writeHeader(r);
+	unlockRange(r->info, HEADERLATCH, 1);
+	unlockRange(r->data, 0, 0);
+	unlatchSplit(r);
+	return r->npages - before;
+}
+
+// move the tuples in bucket b (one of sp..2^d-1) with hash bit
+// d set into a new bucket 2^d+b at the end of the data file,
+// and repack the rest into b's chain
+// b's overflow pages are reused for both, then any left over
+//   go on the free list
+// caller holds the split latch and the whole data file exclusively
+
+static void splitInPlace(Reln r, PageID b)
+{
+	PageID img = (1u << r->depth) + b;
+	PageID p = addPage(r->data);
+	assert(p == img);
+
+	Page *pages;  PageID *pids;
+	Count n = getBucket(r, b, &pages, &pids);
+	Count ntups = 0;
+	for (Count i = 0; i < n; i++) ntups += pageNTuples(pages[i]);
+	char **lo = malloc((ntups+1)*sizeof(char *));
+	char **hi = malloc((ntups+1)*sizeof(char *));
+	assert(lo != NULL && hi != NULL);
+	Count nlo = 0, nhi = 0;
+	for (Count i = 0; i < n; i++) {
+		char *t = pageData(pages[i]);
+		for (Count j = 0; j < pageNTuples(pages[i]); j++, t += strlen(t)+1) {
+			if (t[0] == TOMBSTONE) continue;
+			if (bitAt(tupleHashQuiet(r, t), r->depth))
+				hi[nhi++] = t;
+			else
+				lo[nlo++] = t;
+		}
+	}
+
+	// pids[1..n-1] are spare overflow pages
+	Count nspare = n-1;
+	putChain(r, b, lo, nlo, pids+1, &nspare);
+	putChain(r, img, hi, nhi, pids+1, &nspare);
+	for (Count i = 0; i < nspare; i++) freeOvflowPage(r, pids[1+i]);
+
+	for (Count i = 0; i < n; i++) free(pages[i]);
+	free(pages);  free(pids);  free(lo);  free(hi);
+}
+
+// write tuples[0..n-1] as the chain of bucket p, taking
+// overflow pages from spare[] (which holds *nspare, and keeps
+// the ones not used at its start) or else allocating them
+
+static void putChain(Reln r, PageID p, char **tuples, Count n, PageID *spare, Count *nspare)
+{
+	Page pg = newPage();
+	PageID pid = p;
+	FILE *f = r->data;
+	for (Count i = 0; i < n; i++) {
+		if (addToPage(pg, tuples[i]) == OK) continue;
+		PageID next;
+		if (*nspare > 0)
+			next = spare[--*nspare];
+		else
+			next = allocOvflowPage(r);
+		pageSetOvflow(pg, next);
+		rebuildBloom(r, f, pid, pg);
+		putPage(f, pid, pg);
+		pg = newPage();
+		pid = next;
+		f = r->ovflow;
+		Status ok = addToPage(pg, tuples[i]);
+		assert(ok == OK);
+	}
+	rebuildBloom(r, f, pid, pg);
+	putPage(f, pid, pg);
+	if (r->sig != NULL) {
+		Byte rec[MAXSIGWIDTH/8];
+		memset(rec, 0, sizeof(rec));
+		for (Count i = 0; i < n; i++)
+			if (tuples[i][0] != TOMBSTONE) signTuple(r, rec, tuples[i]);
+		writeSig(r, p, rec);
+	}
+}
+
+// read the chain of bucket p as it is now, for changing it
+// caller holds the split latch, and p's latch exclusively
+// pages[0] is the primary page, the rest are overflow pages;
+// returns #pages, with their ids in *pids (caller frees all)
+
+Count getBucket(Reln r, PageID p, Page **pages, PageID **pids)
+{
+	*pages = NULL;
+	*pids = NULL;
+	return readChain(r->data, r->ovflow, p, pages, pids, 0);
+}
+
+// write back the pages of a bucket read by getBucket() that
+// have changed[i] set, and release them all
+
+void putBucket(Reln r, Count n, Page *pages, PageID *pids, Bool *changed)
+{
+	for (Count i = 0; i < n; i++) {
+		if (!changed[i]) continue;
+		rebuildSig(r, pids[0], pages, n);
+		break;
+	}
+	for (Count i = 0; i < n; i++) {
+		FILE *f = (i == 0) ? r->data : r->ovflow;
+		if (changed[i]) {
+			// drop the values of tuples that were deleted
+			rebuildBloom(r, f, pids[i], pages[i]);
+			putPage(f, pids[i], pages[i]);
+		}
+		else
+			free(pages[i]);
+	}
+}
+
+// n tuples have just been marked as deleted (TOMBSTONE)
+
+void countDeleted(Reln r, Count n)
+{
+	if (n == 0) return;
+	lockRange(r->info, HEADERLATCH, 1, LOCK_EXCL, TRUE);
+	readHeader(r);
+	r->ntups -= n;
+	writeHeader(r);
+	unlockRange(r->info, HEADERLATCH, 1);
+}
+
+// repack the live tuples in bucket p into as few pages of its
+// chain as they need, and put the rest on the free list
+// returns #overflow pages freed
+
+Count compactBucket(Reln r, PageID p)
+{
+	latchSplit(r, LOCK_SHARED);
+	latchBucket(r, p, LOCK_EXCL);
+	Page *pages;  PageID *pids;
+	Count n = getBucket(r, p, &pages, &pids);
+
+	// refill the same pages in chain order, live tuples only
+	Page *packed = malloc(n*sizeof(Page));
+	assert(packed != NULL);
+	Count used = 1;
+	packed[0] = newPage();
+	for (Count i = 0; i < n; i++) {
+		char *t = pageData(pages[i]);
+		for (Count j = 0; j < pageNTuples(pages[i]); j++, t += strlen(t)+1) {
+			if (t[0] == TOMBSTONE) continue;
+			if (addToPage(packed[used-1], t) == OK) continue;
+			packed[used++] = newPage();
+			Status ok = addToPage(packed[used-1], t);
+			assert(ok == OK);
+		}
+		free(pages[i]);
+	}
+	rebuildSig(r, p, packed, used);
+	// link the pages we kept; write them before freeing the others
+	for (Count i = 0; i < used; i++) {
+		FILE *f = (i == 0) ? r->data : r->ovflow;
+		pageSetOvflow(packed[i], (i+1 < used) ? pids[i+1] : NO_PAGE);
+		rebuildBloom(r, f, pids[i], packed[i]);
+		putPage(f, pids[i], packed[i]);
+	}
+	for (Count i = used; i < n; i++) freeOvflowPage(r, pids[i]);
+
+	free(packed);  free(pages);  free(pids);
+	unlatchBucket(r, p);
+	unlatchSplit(r);
+	return n - used;
+}
+
+// wipe an overflow page that's no longer in any chain, and
+// put it on the free list (which needs the header latch)
+
+static void freeOvflowPage(Reln r, PageID pid)
+{
+	Page empty = newPage();
+	rebuildBloom(r, r->ovflow, pid, empty);
+	putPage(r->ovflow, pid, empty);
+	if (r->splitmode == LOCK_EXCL) {
+		StoreEmptyOvPage(r, pid);
+		return;
+	}
+	lockRange(r->info, HEADERLATCH, 1, LOCK_EXCL, TRUE);
+	readHeader(r);
+	StoreEmptyOvPage(r, pid);
+	writeHeader(r);
+	unlockRange(r->info, HEADERLATCH, 1);
+}
+
+// #pages in the chain of bucket b as it is now (0 if it has
+// been merged away since r's snapshot); only reads page headers
+
+Count chainLength(Reln r, PageID b)
+{
+	struct RelnRep h;
+	Count n = 1;
+	latchBucket(r, b, LOCK_SHARED);
+	snapshotHeader(r, &h);
+	if (b >= h.npages) {
+		unlatchBucket(r, b);
+		return 0;
+	}
+	Page pg = getPageCertainInfo(r->data, b);
+	PageID p = pageOvflow(pg);
+	free(pg);
+	for (; p != NO_PAGE; n++) {
+		pg = getPageCertainInfo(r->ovflow, p);
+		p = pageOvflow(pg);
+		free(pg);
+	}
+	unlatchBucket(r, b);
+	return n;
+}
+
+// #hash bits that select bucket b, in r's view of depth and sp
+
+Count bucketDepth(Reln r, PageID b)
+{
+	Bool split = b < r->sp || b >= (1u << r->depth);
+	return split ? r->depth+1 : r->depth;
+}
+
 /**
  * If a overflow A is going to be added to an existing overflow page B,
  * then B.ovflow will record the pid of A.
@@ -373,28 +1600,102 @@ void SplitPage( Reln _r )
 // returns index of bucket where inserted
 // - index always refers to a primary data page
 // - the actual insertion page may be either a data page or an overflow page
-// returns NO_PAGE if insert fails completely
+// returns NO_PAGE if insert fails completely, or DUPLICATE_KEY
+//   (without adding it) if r has a key and t's is already there
 
 PageID addToRelation(Reln r, Tuple t)
+{
+	return addHashedToRelation(r, t, tupleHash(r,t));
+}
+
+// as for addToRelation(), but with tupleHash(r,t) already known
+// (e.g. computed by an earlier stage of a pipelined insert)
+
+PageID addHashedToRelation(Reln r, Tuple t, Bits h)
 {
 	int C = 1024/(10*r->nattrs) ;
-	if( r->ntups % C == 0 && r->ntups != 0 ) {
-		SplitPage( r );
+	if (r->wal != NULL) {
+		// we're the only writer, and scans can't see any of
+		// this until commit, so no latches or shadow needed
+		if (keyTaken(r, t, NULL)) return DUPLICATE_KEY;
+		Count n = r->ntups++;
+		if( n % C == 0 && n != 0 && splitDue( r, C ) ) {
+			PageID s = r->sp, img = (1u << r->depth) + r->sp;
+			SplitPage( r );
+			rebuildBucketBloom(r, s);
+			rebuildBucketBloom(r, img);
+			rebuildBucketSig(r, img);
+			rebuildBucketSig(r, s);
+			r->gen++;
+		}
+		Bits p = lowerBits(h, r->depth);
+		if (p < r->sp) p = lowerBits(h, r->depth+1);
+		noteValues(r, t);
+		PageID result = addToBucket(r, t, p);
+		indexTuple(r, t, h);
+		writeHeader(r);
+		if (++r->logged >= WALGROUP || walDirty(r->wal) >= WALMAXDIRTY)
+			commitRelation(r);
+		return result;
+	}
+	Count opens = r->opens;
+	latchSplit(r, LOCK_SHARED);
+	Offset key;
+	if (keyTaken(r, t, &key)) {
+		unlockRange(r->info, key, 1);
+		unlatchSplit(r);
+		return DUPLICATE_KEY;
 	}
 
-	Bits h, p;
-	h = tupleHash(r,t);
-	if (r->depth == 0)
-		p = 1;
-	else {
-		p = getLower(h, r->depth);
-		if (p < r->sp) p = getLower(h, r->depth+1);
+	// count the tuple here, and only add our count to the header's
+	//   ntups every C inserts (and at close), so inserts don't all
+	//   queue up on the header; the insert that adds it then does
+	//   the next split, if one is due, once other scans and
+	//   inserts finish (a writer that dies leaves < C uncounted)
+	if (++r->added == C) {
+		// the key latch comes after the split latch, so let it go
+		//   and check again after the split
+		if (r->key != 0) unlockRange(r->info, key, 1);
+		unlatchSplit(r);
+		latchSplit(r, LOCK_EXCL);
+		r->ntups += r->added;
+		r->added = 0;
+		if (splitDue(r, C)) splitBucket(r);
+		unlatchSplit(r);
+		latchSplit(r, LOCK_SHARED);
+		if (keyTaken(r, t, &key)) {
+			unlockRange(r->info, key, 1);
+			countDeleted(r, 1);
+			unlatchSplit(r);
+			return DUPLICATE_KEY;
+		}
 	}
 
+	// depth and sp can't change while we hold the split latch
+	// (h is from the old choice vector if r has been replaced)
+	if (r->opens != opens) h = tupleHashQuiet(r, t);
+	Bits p = routeTo(r->depth, r->sp, h);
+
+	noteValues(r, t);
+	latchBucket(r, p, LOCK_EXCL);
+	PageID result = addToBucket(r, t, p);
+	unlatchBucket(r, p);
+	indexTuple(r, t, h);
+	if (r->key != 0) unlockRange(r->info, key, 1);
+	unlatchSplit(r);
+	return result;
+}
+
+// add a tuple to the chain of pages for bucket p
+// caller holds the latches, and has already counted the tuple
+
+static PageID addToBucket(Reln r, Tuple t, PageID p)
+{
+	addToSignature(r, p, t);
 	Page pg = getPage(r->data,p);
 	if (addToPage(pg,t) == OK) {
 		putPage(r->data,p,pg);
-		r->ntups++;
+		addToBloom(r, r->data, p, t);
 		return p;
 	}
 
@@ -403,7 +1704,7 @@ PageID addToRelation(Reln r, Tuple t)
 	if (pageOvflow(pg) == NO_PAGE) {
 		// add first overflow page in chain
 		// create a new overflow page 
-		PageID newp = addNewoverflowPage(r->ovflow, r);
+		PageID newp = allocOvflowPage(r);
 		// set this page as overflow page of existing primary page(pg)
 		pageSetOvflow(pg,newp);
 		putPage(r->data,p,pg);
@@ -415,7 +1716,7 @@ PageID addToRelation(Reln r, Tuple t)
 		}
 
 		putPage(r->ovflow,newp,newpg);
-		r->ntups++;
+		addToBloom(r, r->ovflow, newp, t);
 		return p;
 	}
 	else {
@@ -440,8 +1741,8 @@ PageID addToRelation(Reln r, Tuple t)
 
 				// putPage() help us free "ovpg"
 				putPage(r->ovflow,ovp,ovpg);
-				r->ntups++;
-				free( pg );
+				addToBloom(r, r->ovflow, ovp, t);
+						free( pg );
 				return p;
 			}
 		}
@@ -449,15 +1750,15 @@ PageID addToRelation(Reln r, Tuple t)
 		// at this point, there *must* be a prevpg
 		assert(prevpg != NULL);
 		// make new ovflow page
-		PageID newp = addNewoverflowPage(r->ovflow, r);
+		PageID newp = allocOvflowPage(r);
 		// insert tuple into new page
 		Page newpg = getPage(r->ovflow,newp);
         if (addToPage(newpg,t) != OK) return NO_PAGE;
         putPage(r->ovflow,newp,newpg);
+		addToBloom(r, r->ovflow, newp, t);
 		// link to existing overflow chain
 		pageSetOvflow(prevpg,newp);	
 		putPage(r->ovflow,prevp,prevpg);
-        r->ntups++;
 		free( pg );
 		return p;
 	}
@@ -469,7 +1770,7 @@ PageID addToRelationSplitVersion(Reln r, Tuple t)
 {
 	Bits h, p;
 	h = tupleHash(r,t);
-	p = getLower(h, r->depth+1);
+	p = lowerBits(h, r->depth+1);
 
 
 	Page pg = getPage(r->data,p);
@@ -485,7 +1786,7 @@ PageID addToRelationSplitVersion(Reln r, Tuple t)
 	if (pageOvflow(pg) == NO_PAGE) {
 		// add first overflow page in chain
 		// create a new overflow page 
-		PageID newp = addNewoverflowPage(r->ovflow, r);
+		PageID newp = allocOvflowPage(r);
 		// set this page as overflow page of existing primary page(pg)
 		pageSetOvflow(pg,newp);
 		// this putPage() is basically writing only one new info which is page->ovflow
@@ -529,7 +1830,7 @@ PageID addToRelationSplitVersion(Reln r, Tuple t)
 		// at this point, there *must* be a prevpg
 		assert(prevpg != NULL);
 		// make new ovflow page
-		PageID newp = addNewoverflowPage(r->ovflow, r);
+		PageID newp = allocOvflowPage(r);
 		// insert tuple into new page
 		Page newpg = getPage(r->ovflow,newp);
         if (addToPage(newpg,t) != OK) return NO_PAGE;
@@ -554,26 +1855,681 @@ FILE *ovflowFile(Reln r) { return r->ovflow; }
 Count nattrs(Reln r) { return r->nattrs; }
 Count npages(Reln r) { return r->npages; }
 Count ntuples(Reln r) { return r->ntups; }
+Bits keyAttrs(Reln r) { return r->key; }
+OrderSpec *orderSpec(Reln r) { return &r->order; }
 Count depth(Reln r)  { return r->depth; }
 Count splitp(Reln r) { return r->sp; }
 ChVecItem *chvec(Reln r)  { return r->cv; }
+HashFn hashfn(Reln r) { return r->hash; }
+ChVecPlan *chvecPlan(Reln r) { return &r->plan; }
+HashMemo hashMemo(Reln r) { return r->memo; }
+
+// R.bloom has one record per page: a Bloom filter (see bloom.h)
+//   for each attribute, holding the values on the page
+// data page p has record 2p, overflow page p record 2p+1
+// a record past the end of the file is all zero, i.e. empty
+// filters only gain values as tuples are added; deleted values
+//   go when the page is rebuilt (by a split, compact or delete)
+// records are written under the page's bucket latch, and logged
+//   with the pages when r is logging (see logRelation())
+
+static void readBloom(Reln r, FILE *f, PageID pid, Byte *rec)
+{
+	Count len = r->nattrs*BLOOMBYTES;
+	Offset off = (2*pid + (f == r->ovflow)) * len;
+	if (walGetBytes(r->bloom, off, rec, len)) return;
+	memset(rec, 0, len);
+	ssize_t n = pread(fileno(r->bloom), rec, len, off);
+	assert(n >= 0);
+}
+
+static void writeBloom(Reln r, FILE *f, PageID pid, Byte *rec)
+{
+	Count len = r->nattrs*BLOOMBYTES;
+	Offset off = (2*pid + (f == r->ovflow)) * len;
+	if (r->wal != NULL) {
+		walPutBytes(r->wal, r->bloom, off, rec, len);
+		return;
+	}
+	ssize_t n = pwrite(fileno(r->bloom), rec, len, off);
+	assert(n == len);
+}
+
+// t has just been added to page pid of f
+
+static void addToBloom(Reln r, FILE *f, PageID pid, Tuple t)
+{
+	if (r->bloom == NULL) return;
+	Byte rec[MAXATTRS*BLOOMBYTES];
+	char *vals[MAXATTRS];
+	readBloom(r, f, pid, rec);
+	tupleVals(t, vals);
+	for (Count i = 0; i < r->nattrs; i++) {
+		bloomAdd(&rec[i*BLOOMBYTES], valueHash(r, vals[i]));
+		free(vals[i]);
+	}
+	writeBloom(r, f, pid, rec);
+}
+
+// filters for just the live tuples on pg, which goes at pid in f
+
+static void rebuildBloom(Reln r, FILE *f, PageID pid, Page pg)
+{
+	if (r->bloom == NULL) return;
+	Byte rec[MAXATTRS*BLOOMBYTES];
+	char *vals[MAXATTRS];
+	memset(rec, 0, sizeof(rec));
+	char *t = pageData(pg);
+	for (Count j = 0; j < pageNTuples(pg); j++, t += strlen(t)+1) {
+		if (t[0] == TOMBSTONE) continue;
+		tupleVals(t, vals);
+		for (Count i = 0; i < r->nattrs; i++) {
+			bloomAdd(&rec[i*BLOOMBYTES], valueHash(r, vals[i]));
+			free(vals[i]);
+		}
+	}
+	writeBloom(r, f, pid, rec);
+}
+
+// after SplitPage(), which moves tuples around in both buckets
+
+static void rebuildBucketBloom(Reln r, PageID b)
+{
+	if (r->bloom == NULL) return;
+	Page *pages;  PageID *pids;
+	Count n = getBucket(r, b, &pages, &pids);
+	for (Count i = 0; i < n; i++) {
+		rebuildBloom(r, (i == 0) ? r->data : r->ovflow, pids[i], pages[i]);
+		free(pages[i]);
+	}
+	free(pages);  free(pids);
+}
+
+// could page pid of f hold a tuple with all of probe's values?
+
+static Bool pageMayMatch(Reln r, FILE *f, PageID pid, ValueProbe *probe)
+{
+	if (r->bloom == NULL || probe->known == 0) return TRUE;
+	Byte rec[MAXATTRS*BLOOMBYTES];
+	readBloom(r, f, pid, rec);
+	for (Count i = 0; i < r->nattrs; i++) {
+		if (!bitAt(probe->known, i)) continue;
+		if (!bloomMayHave(&rec[i*BLOOMBYTES], probe->hash[i])) return FALSE;
+	}
+	return TRUE;
+}
+
+// R.sig has a header, then one record per bucket: its signature
+//   (see sig.h), for the values of the tuples in its chain
+// scans of R.sig don't take bucket latches, so a record gains a
+//   tuple's values before its page does, and after a split img's
+//   is rebuilt before s's; records only lose values when they're
+//   rebuilt from the chain (after a split, compact or delete)
+// a merged-away bucket's record stays until it's split again
+// records are logged with the pages when r is logging
+
+static void readSig(Reln r, PageID b, Byte *rec)
+{
+	Count len = r->sigwidth/8;
+	Offset off = SIGHDR + b*len;
+	if (walGetBytes(r->sig, off, rec, len)) return;
+	memset(rec, 0, len);
+	ssize_t n = pread(fileno(r->sig), rec, len, off);
+	assert(n >= 0);
+}
+
+static void writeSig(Reln r, PageID b, Byte *rec)
+{
+	Count len = r->sigwidth/8;
+	Offset off = SIGHDR + b*len;
+	if (r->wal != NULL) {
+		walPutBytes(r->wal, r->sig, off, rec, len);
+		return;
+	}
+	ssize_t n = pwrite(fileno(r->sig), rec, len, off);
+	assert(n == len);
+}
+
+// add the values of tuple t to signature rec
+
+static void signTuple(Reln r, Byte *rec, char *t)
+{
+	char *vals[MAXATTRS];
+	tupleVals(t, vals);
+	for (Count i = 0; i < r->nattrs; i++) {
+		sigAdd(rec, r->sigwidth, r->sigk, i, valueHash(r, vals[i]));
+		free(vals[i]);
+	}
+}
+
+// t is about to be added to bucket b
+
+static void addToSignature(Reln r, PageID b, Tuple t)
+{
+	if (r->sig == NULL) return;
+	Byte rec[MAXSIGWIDTH/8], old[MAXSIGWIDTH/8];
+	readSig(r, b, rec);
+	memcpy(old, rec, r->sigwidth/8);
+	signTuple(r, rec, t);
+	// values already there (the usual case, once it fills up)
+	if (memcmp(old, rec, r->sigwidth/8) == 0) return;
+	writeSig(r, b, rec);
+}
+
+// signature of just the live tuples on pages[0..n-1], the chain
+// of bucket b
+
+static void rebuildSig(Reln r, PageID b, Page *pages, Count n)
+{
+	if (r->sig == NULL) return;
+	Byte rec[MAXSIGWIDTH/8];
+	memset(rec, 0, sizeof(rec));
+	for (Count i = 0; i < n; i++) {
+		char *t = pageData(pages[i]);
+		for (Count j = 0; j < pageNTuples(pages[i]); j++, t += strlen(t)+1)
+			if (t[0] != TOMBSTONE) signTuple(r, rec, t);
+	}
+	writeSig(r, b, rec);
+}
+
+static void rebuildBucketSig(Reln r, PageID b)
+{
+	if (r->sig == NULL) return;
+	Page *pages;  PageID *pids;
+	Count n = getBucket(r, b, &pages, &pids);
+	rebuildSig(r, b, pages, n);
+	for (Count i = 0; i < n; i++) free(pages[i]);
+	free(pages);  free(pids);
+}
+
+// give r a signature file, with width-bit signatures and k bits
+// for each value, for the buckets it has now
+// other processes that already have r open won't keep it up to
+//   date, so it's for relations nobody else is using yet
+// caller holds the split latch exclusively; ~OK if r already
+//   has one, or is logging, or width and k won't do
+
+Status addSignatures(Reln r, Count width, Count k)
+{
+	char fname[MAXFILENAME];
+	if (r->sig != NULL || r->bloom == NULL || r->wal != NULL) return ~OK;
+	if (!sigValid(width, k)) return ~OK;
+	sprintf(fname,"%s.sig",r->name);
+	r->sig = fopen(fname,"w+");
+	assert(r->sig != NULL);
+	setvbuf(r->sig, NULL, _IONBF, 0);
+	Byte hdr[SIGHDR];
+	SigHeader h = { SIGMAGIC, width, k };
+	memset(hdr, 0, SIGHDR);
+	memcpy(hdr, &h, sizeof(SigHeader));
+	int n = fwrite(hdr, SIGHDR, 1, r->sig);
+	assert(n == 1);
+	r->sigwidth = width;
+	r->sigk = k;
+	for (PageID b = 0; b < r->npages; b++) rebuildBucketSig(r, b);
+	return OK;
+}
+
+// width of r's signatures, and bits per value in *k
+// (0 if it has none)
+
+Count signatureWidth(Reln r, Count *k)
+{
+	*k = r->sigk;
+	return (r->sig == NULL) ? 0 : r->sigwidth;
+}
 
+// the buckets whose signatures have all of query's bits, into
+//   *match (to be freed), adding the #pages read to *pages
+// they're the buckets of the latest version, so some may have
+//   been split or merged since r's snapshot
+// holds bucket 0's latch, so no group commit or growRelation()
+//   is part way through
+
+Count scanSignatures(Reln r, Byte *query, PageID **match, Count *pages)
+{
+	assert(r->sig != NULL);
+	latchBucket(r, 0, LOCK_SHARED);
+	Count n = sigScan(r->sig, r->sigwidth, query, match, pages);
+	unlatchBucket(r, 0);
+	return n;
+}
+
+// is there already a live tuple with t's key values?
+// it can only be in the buckets whose hash bits agree with the
+//   key's (just one, if the choice vector only uses the key's
+//   bits), and only on pages whose filters have the key values
+// unless r is logging, the caller holds the split latch, and
+//   this takes the key's latch (at *latch) which the caller
+//   releases once t is in place, so nobody adds the same key
+//   meanwhile
+// FALSE (and nothing latched) if r has no key
+
+static Bool keyTaken(Reln r, Tuple t, Offset *latch)
+{
+	if (r->key == 0) return FALSE;
+	char *vals[MAXATTRS], *other[MAXATTRS];
+	ValueProbe probe;
+	Bits slot = 0, h[MAXATTRS];
+	tupleVals(t, vals);
+	probe.known = r->key;
+	for (Count i = 0; i < r->nattrs; i++) {
+		if (!bitAt(r->key, i)) continue;
+		probe.hash[i] = valueHash(r, vals[i]);
+		h[i] = attrHash(r, i, vals[i]);
+		slot = fmix32(slot ^ probe.hash[i]);
+	}
+	if (latch != NULL) {
+		*latch = KEYLATCH + slot % KEYLATCHES;
+		lockRange(r->info, *latch, 1, LOCK_EXCL, TRUE);
+	}
+	Bits known = chvecGather(&r->plan, h, r->key);
+	Bits knownPos = chvecPositions(&r->plan, r->key);
+
+	Bool taken = FALSE;
+	PageID b = nextBucketAgreeing(r->depth, r->sp, known, knownPos, NO_PAGE);
+	for (; b != NO_PAGE && !taken; b = nextBucketAgreeing(r->depth, r->sp, known, knownPos, b)) {
+		Page *pages = NULL;
+		if (r->wal == NULL) latchBucket(r, b, LOCK_SHARED);
+		Count n = readChainMatching(r, b, &probe, &pages, 0);
+		if (r->wal == NULL) unlatchBucket(r, b);
+		for (Count i = 0; i < n; i++) {
+			char *u = pageData(pages[i]);
+			for (Count j = 0; j < pageNTuples(pages[i]) && !taken; j++, u += strlen(u)+1) {
+				if (u[0] == TOMBSTONE) continue;
+				tupleVals(u, other);
+				taken = TRUE;
+				for (Count a = 0; a < r->nattrs; a++) {
+					if (bitAt(r->key, a) && strcmp(vals[a], other[a]) != 0)
+						taken = FALSE;
+					free(other[a]);
+				}
+			}
+			free(pages[i]);
+		}
+		free(pages);
+	}
+	for (Count i = 0; i < r->nattrs; i++) free(vals[i]);
+	return taken;
+}
+
+// remember attribute hashes for the rest of this process
+// inserts and splits then hash each distinct value once
+
+void useHashMemo(Reln r)
+{
+	if (r->memo == NULL) r->memo = newHashMemo(r->hash);
+}
+
+
+// attribute statistics are gathered in memory as tuples are
+// added, and merged into name.stats when r is closed, so
+//   they never need a pass over the data
+// deleted tuples stay counted; they are estimates anyway
+
+static void noteValues(Reln r, Tuple t)
+{
+	if (r->stats == NULL) {
+		r->stats = calloc(r->nattrs, sizeof(AttrStats));
+		assert(r->stats != NULL);
+	}
+	char **vals = malloc(r->nattrs*sizeof(char *));
+	assert(vals != NULL);
+	tupleVals(t, vals);
+	for (Count i = 0; i < r->nattrs; i++)
+		statsAdd(&r->stats[i], vals[i], valueHash(r, vals[i]));
+	freeVals(vals, r->nattrs);
+}
+
+static void saveStats(Reln r)
+{
+	char fname[MAXFILENAME];
+	sprintf(fname,"%s.stats",r->name);
+	FILE *f = fopen(fname,"r+");
+	if (f == NULL) f = fopen(fname,"w+");
+	assert(f != NULL);
+	lockRange(f, 0, 0, LOCK_EXCL, TRUE);
+	AttrStats *all = calloc(r->nattrs, sizeof(AttrStats));
+	assert(all != NULL);
+	fseek(f, 0, SEEK_SET);
+	// a new file reads as empty statistics
+	fread(all, sizeof(AttrStats), r->nattrs, f);
+	for (Count i = 0; i < r->nattrs; i++) statsMerge(&all[i], &r->stats[i]);
+	fseek(f, 0, SEEK_SET);
+	int n = fwrite(all, sizeof(AttrStats), r->nattrs, f);
+	assert(n == r->nattrs);
+	fflush(f);
+	unlockRange(f, 0, 0);
+	fclose(f);
+	free(all);
+}
+
+// statistics for each attribute of r, including what r has
+// added but not yet saved; NULL if there aren't any
+// caller frees the array
+
+AttrStats *loadStats(Reln r)
+{
+	char fname[MAXFILENAME];
+	sprintf(fname,"%s.stats",r->name);
+	AttrStats *all = calloc(r->nattrs, sizeof(AttrStats));
+	assert(all != NULL);
+	FILE *f = fopen(fname,"r");
+	Count n = 0;
+	if (f != NULL) {
+		lockRange(f, 0, 0, LOCK_SHARED, TRUE);
+		n = fread(all, sizeof(AttrStats), r->nattrs, f);
+		unlockRange(f, 0, 0);
+		fclose(f);
+	}
+	if (n != r->nattrs && r->stats == NULL) {
+		free(all);
+		return NULL;
+	}
+	if (r->stats != NULL)
+		for (Count i = 0; i < r->nattrs; i++) statsMerge(&all[i], &r->stats[i]);
+	return all;
+}
+
+// R.idx.a is a B+-tree index (see btree.h) on attribute a,
+//   from each value to the hashes of the tuples that have it
+// R.bmp.a is a bitmap index (see roaring.h) on a, from the hash
+//   of each value to the hash slots (the lower SLOTBITS bits of
+//   the hashes) of the tuples that have it; it's the same as an
+//   index in all of the ways below
+// a hash finds its tuple's bucket whatever depth and sp are, so
+//   splits and merges don't change the index, and nor do deletes
+//   (the tuple just isn't found), only inserts
+// the hashes depend on the choice vector, hash function and
+//   order-preserving attributes, so the index keeps a stamp of
+//   them, and isn't used if they've changed since it was built
+// an index made (or dropped) while r is open is picked up by
+//   writers when they next take the split latch, as the header's
+//   indexes count has changed (caller of build/drop holds the
+//   split latch exclusively, so it's published on release)
+
+static void openIndexes(Reln r)
+{
+	char fname[MAXFILENAME];
+	r->seen = r->indexes;
+	for (Count a = 0; a < r->nattrs; a++) {
+		if (r->idx[a] != NULL && replaced(btreeFile(r->idx[a]))) {
+			closeBTree(r->idx[a]);
+			r->idx[a] = NULL;
+		}
+		if (r->bmp[a] != NULL && replaced(bitmapIndexFile(r->bmp[a]))) {
+			closeBitmapIndex(r->bmp[a]);
+			r->bmp[a] = NULL;
+		}
+		if (r->idx[a] == NULL) {
+			sprintf(fname,"%s.idx.%d",r->name,a);
+			r->idx[a] = openBTree(fname, (r->mode == 'w') ? "r+" : "r");
+		}
+		if (r->bmp[a] == NULL) {
+			sprintf(fname,"%s.bmp.%d",r->name,a);
+			r->bmp[a] = openBitmapIndex(fname, (r->mode == 'w') ? "r+" : "r");
+		}
+	}
+}
+
+static void closeIndexes(Reln r)
+{
+	for (Count a = 0; a < r->nattrs; a++) {
+		if (r->idx[a] != NULL) closeBTree(r->idx[a]);
+		if (r->bmp[a] != NULL) closeBitmapIndex(r->bmp[a]);
+		r->idx[a] = NULL;
+		r->bmp[a] = NULL;
+	}
+}
+
+// add tuple t (with hash h) to r's indexes
+
+static void indexTuple(Reln r, Tuple t, Bits h)
+{
+	char *vals[MAXATTRS];
+	Bool any = FALSE;
+	for (Count a = 0; a < r->nattrs; a++)
+		any = any || r->idx[a] != NULL || r->bmp[a] != NULL;
+	if (!any) return;
+	tupleVals(t, vals);
+	for (Count a = 0; a < r->nattrs; a++) {
+		if (r->idx[a] != NULL) btreeInsert(r->idx[a], vals[a], h);
+		if (r->bmp[a] != NULL)
+			bitmapIndexAdd(r->bmp[a], valueHash(r, vals[a]), lowerBits(h, SLOTBITS));
+		free(vals[a]);
+	}
+}
+
+// t has replaced old in place, with the same hash, so add the
+// values that changed to r's indexes (see replaceCurrentTuple())
+// caller holds the split latch
+
+void reindexTuple(Reln r, Tuple old, Tuple t)
+{
+	char *ov[MAXATTRS], *nv[MAXATTRS];
+	Bits h = tupleHashQuiet(r, t);
+	tupleVals(old, ov);
+	tupleVals(t, nv);
+	for (Count a = 0; a < r->nattrs; a++) {
+		if (strcmp(ov[a], nv[a]) != 0) {
+			if (r->idx[a] != NULL) btreeInsert(r->idx[a], nv[a], h);
+			if (r->bmp[a] != NULL)
+				bitmapIndexAdd(r->bmp[a], valueHash(r, nv[a]), lowerBits(h, SLOTBITS));
+		}
+		free(ov[a]);
+		free(nv[a]);
+	}
+}
+
+// what an index's hashes depend on
+
+static Bits layoutStamp(Reln r)
+{
+	Bits s = fmix32(r->hashfn + 1);
+	for (Count i = 0; i < MAXCHVEC; i++)
+		s = fmix32(s ^ (r->cv[i].att << 8 | r->cv[i].bit));
+	s = fmix32(s ^ r->order.attrs);
+	for (Count a = 0; a < r->nattrs; a++) {
+		if (!bitAt(r->order.attrs, a)) continue;
+		s = fmix32(s ^ r->order.lo[a]);
+		s = fmix32(s ^ r->order.hi[a]);
+	}
+	return s;
+}
+
+// r's index on attribute a, if it has an up to date one
+
+BTree attrIndex(Reln r, Count a)
+{
+	if (r->idx[a] == NULL || btreeStamp(r->idx[a]) != layoutStamp(r)) return NULL;
+	return r->idx[a];
+}
+
+// is there an index on a, but one that's out of date?
+
+Bool staleIndex(Reln r, Count a)
+{
+	return r->idx[a] != NULL && btreeStamp(r->idx[a]) != layoutStamp(r);
+}
+
+// (re)build the index on attribute a from r's tuples, in
+// R.idx.a.new, then move it into place
+// caller holds the split latch exclusively, so no inserts are
+//   missed; inserts after it go into the new index
+
+void buildIndex(Reln r, Count a)
+{
+	char fname[MAXFILENAME], tmp[MAXFILENAME+4];
+	sprintf(fname,"%s.idx.%d",r->name,a);
+	sprintf(tmp,"%s.new",fname);
+	BTree t = newBTree(tmp, layoutStamp(r));
+	assert(t != NULL);
+	char *vals[MAXATTRS];
+	for (PageID b = 0; b < r->npages; b++) {
+		Page *pages;  PageID *pids;
+		Count np = getBucket(r, b, &pages, &pids);
+		for (Count i = 0; i < np; i++) {
+			char *u = pageData(pages[i]);
+			for (Count j = 0; j < pageNTuples(pages[i]); j++, u += strlen(u)+1) {
+				if (u[0] == TOMBSTONE) continue;
+				tupleVals(u, vals);
+				btreeInsert(t, vals[a], tupleHashQuiet(r, u));
+				for (Count k = 0; k < r->nattrs; k++) free(vals[k]);
+			}
+			free(pages[i]);
+		}
+		free(pages);  free(pids);
+	}
+	fflush(btreeFile(t));
+	int ok = fsync(fileno(btreeFile(t)));
+	assert(ok == 0);
+	closeBTree(t);
+	ok = rename(tmp, fname);
+	assert(ok == 0);
+	r->indexes++;
+	openIndexes(r);
+}
+
+// remove the index on attribute a (if any)
+
+void dropIndex(Reln r, Count a)
+{
+	char fname[MAXFILENAME];
+	sprintf(fname,"%s.idx.%d",r->name,a);
+	unlink(fname);
+	if (r->idx[a] != NULL) closeBTree(r->idx[a]);
+	r->idx[a] = NULL;
+	r->indexes++;
+}
+
+// r's bitmap index on attribute a, if it has an up to date one
+
+BitmapIndex attrBitmap(Reln r, Count a)
+{
+	if (r->bmp[a] == NULL || bitmapIndexStamp(r->bmp[a]) != layoutStamp(r)) return NULL;
+	return r->bmp[a];
+}
+
+Bool staleBitmap(Reln r, Count a)
+{
+	return r->bmp[a] != NULL && bitmapIndexStamp(r->bmp[a]) != layoutStamp(r);
+}
+
+// (re)build the bitmap index on attribute a, as for buildIndex(),
+// from the (value hash,slot) pairs of r's tuples, sorted
+
+void buildBitmap(Reln r, Count a)
+{
+	char fname[MAXFILENAME], tmp[MAXFILENAME+4];
+	sprintf(fname,"%s.bmp.%d",r->name,a);
+	sprintf(tmp,"%s.new",fname);
+	Count n = 0, size = 1024;
+	unsigned long long *pairs = malloc(size*sizeof(unsigned long long));
+	assert(pairs != NULL);
+	char *vals[MAXATTRS];
+	for (PageID b = 0; b < r->npages; b++) {
+		Page *pages;  PageID *pids;
+		Count np = getBucket(r, b, &pages, &pids);
+		for (Count i = 0; i < np; i++) {
+			char *u = pageData(pages[i]);
+			for (Count j = 0; j < pageNTuples(pages[i]); j++, u += strlen(u)+1) {
+				if (u[0] == TOMBSTONE) continue;
+				if (n == size) {
+					size *= 2;
+					pairs = realloc(pairs, size*sizeof(unsigned long long));
+					assert(pairs != NULL);
+				}
+				tupleVals(u, vals);
+				pairs[n++] = (unsigned long long)valueHash(r, vals[a]) << 32
+				             | lowerBits(tupleHashQuiet(r, u), SLOTBITS);
+				for (Count k = 0; k < r->nattrs; k++) free(vals[k]);
+			}
+			free(pages[i]);
+		}
+		free(pages);  free(pids);
+	}
+	qsort(pairs, n, sizeof(unsigned long long), byPair);
+	BitmapIndex x = newBitmapIndex(tmp, layoutStamp(r), pairs, n);
+	assert(x != NULL);
+	free(pairs);
+	int ok = fsync(fileno(bitmapIndexFile(x)));
+	assert(ok == 0);
+	closeBitmapIndex(x);
+	ok = rename(tmp, fname);
+	assert(ok == 0);
+	r->indexes++;
+	openIndexes(r);
+}
+
+static int byPair(const void *a, const void *b)
+{
+	unsigned long long x = *(unsigned long long *)a, y = *(unsigned long long *)b;
+	return (x > y) - (x < y);
+}
+
+void dropBitmap(Reln r, Count a)
+{
+	char fname[MAXFILENAME];
+	sprintf(fname,"%s.bmp.%d",r->name,a);
+	unlink(fname);
+	if (r->bmp[a] != NULL) closeBitmapIndex(r->bmp[a]);
+	r->bmp[a] = NULL;
+	r->indexes++;
+}
 
 // displays info about open Reln
 
 void relationStats(Reln r)
 {
+	latchSplit(r, LOCK_SHARED);
 	printf("Global Info:\n");
-	printf("#attrs:%d  #pages:%d  #tuples:%d  d:%d  sp:%d\n",
-	       r->nattrs, r->npages, r->ntups, r->depth, r->sp);
+	printf("#attrs:%d  #pages:%d  #tuples:%d  d:%d  sp:%d  hash:%s",
+	       r->nattrs, r->npages, r->ntups, r->depth, r->sp, hashName(r->hashfn));
+	if (r->key != 0) {
+		printf("  key:");
+		for (Count i = 0, n = 0; i < r->nattrs; i++)
+			if (bitAt(r->key, i)) printf("%s%d", (n++ > 0) ? "," : "", i);
+	}
+	if (r->order.attrs != 0) {
+		printf("  ordered:");
+		for (Count i = 0, n = 0; i < r->nattrs; i++)
+			if (bitAt(r->order.attrs, i))
+				printf("%s%d:%d..%d", (n++ > 0) ? "," : "", i, r->order.lo[i], r->order.hi[i]);
+	}
+	putchar('\n');
+	for (Count a = 0; a < r->nattrs; a++) {
+		if (r->idx[a] == NULL) continue;
+		Count pages, height, n = btreeSize(r->idx[a], &pages, &height);
+		printf("Index on %d: %d entries, %d pages, height %d%s\n", a, n, pages, height,
+		       staleIndex(r, a) ? " (out of date; rebuild with ./index)" : "");
+	}
+	for (Count a = 0; a < r->nattrs; a++) {
+		if (r->bmp[a] == NULL) continue;
+		Count added, pages, n = bitmapIndexSize(r->bmp[a], &added, &pages);
+		printf("Bitmap index on %d: %d values, %d added since built, %d pages%s\n",
+		       a, n, added, pages,
+		       staleBitmap(r, a) ? " (out of date; rebuild with ./bitmap)" : "");
+	}
+	if (r->sig != NULL)
+		printf("Signatures: %d bits per bucket, %d per value\n", r->sigwidth, r->sigk);
 	
 	printf("Choice vector\n");
 	printChVec(r->cv);
+	AttrStats *st = loadStats(r);
+	if (st != NULL) {
+		printf("Attribute Info:\n");
+		for (Count i = 0; i < r->nattrs; i++) {
+			printf("[%d]  ", i);
+			printAttrStats(&st[i]);
+		}
+		free(st);
+	}
 	printf("Bucket Info:\n");
 	printf("%-4s %s\n","#","Info on pages in bucket");
 	printf("%-4s %s\n","","(pageID,#tuples,freebytes,ovflow)");
 	for (Offset pid = 0; pid < r->npages; pid++) {
 		printf("[%2d]  ",pid);
+		latchBucket(r, pid, LOCK_SHARED);
 		Page p = getPage(r->data, pid);
 		Count ntups = pageNTuples(p);
 		Count space = pageFreeSpace(p);
@@ -589,8 +2545,10 @@ void relationStats(Reln r)
 			printf(" -> (ov%d,%d,%d,%d)",curid,ntups,space,ovid);
 			free(p);
 		}
+		unlatchBucket(r, pid);
 		putchar('\n');
 	}
+	unlatchSplit(r);
 }
 
 /**
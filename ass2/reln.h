@@ -8,24 +8,89 @@
 
 typedef struct RelnRep *Reln;
 
+// what addToRelation() returns if the tuple's key is taken
+#define DUPLICATE_KEY (NO_PAGE-1)
+
 #include "defs.h"
 #include "tuple.h"
 #include "page.h"
 #include "chvec.h"
+#include "hash.h"
+#include "lock.h"
+#include "sketch.h"
+#include "btree.h"
+#include "roaring.h"
+
+// values a scan is looking for: hash[i] of attribute i, for
+// each i in known (see readBucketMatching())
+typedef struct {
+	Bits known;
+	Bits hash[MAXATTRS];
+} ValueProbe;
+
+// attributes whose hash preserves the order of their values
+// (bit i for attribute i), which are ints in lo[i]..hi[i]
+// (see orderHash())
+typedef struct {
+	Bits attrs;
+	int  lo[MAXATTRS];
+	int  hi[MAXATTRS];
+} OrderSpec;
 
-Status newRelation(char *name, Count nattr, Count npages, Count d, char *cv);
+Status newRelation(char *name, Count nattr, Count npages, Count d, Count sp, char *cv, Count hf, Count expect, Bits key, OrderSpec *order);
 Reln openRelation(char *name, char *mode);
 void closeRelation(Reln r);
+Status copyRelation(Reln r, char *name, char *cv);
+void replaceRelation(Reln r, char *name);
+void logRelation(Reln r, char *name);
+void commitRelation(Reln r);
 Bool existsRelation(char *name);
 PageID addToRelation(Reln r, Tuple t);
+PageID addHashedToRelation(Reln r, Tuple t, Bits h);
 FILE *dataFile(Reln r);
 FILE *ovflowFile(Reln r);
 Count nattrs(Reln r);
 Count npages(Reln r);
+Count ntuples(Reln r);
+Bits keyAttrs(Reln r);
+OrderSpec *orderSpec(Reln r);
 Count depth(Reln r);
 Count splitp(Reln r);
 ChVecItem *chvec(Reln r);
+HashFn hashfn(Reln r);
+ChVecPlan *chvecPlan(Reln r);
+HashMemo hashMemo(Reln r);
+void useHashMemo(Reln r);
 void relationStats(Reln r);
+AttrStats *loadStats(Reln r);
+void refreshRelation(Reln r);
+void latchSplit(Reln r, int mode);
+void unlatchSplit(Reln r);
+void latchBucket(Reln r, PageID p, int mode);
+void unlatchBucket(Reln r, PageID p);
+Count readBucket(Reln r, PageID b, Count bits, Page **pages);
+Count readBucketMatching(Reln r, PageID b, Count bits, ValueProbe *probe, Page **pages);
+Count bucketDepth(Reln r, PageID b);
+PageID nextBucketAgreeing(Count depth, Offset sp, Bits known, Bits knownPos, PageID b);
+Count chainLength(Reln r, PageID b);
+Count getBucket(Reln r, PageID p, Page **pages, PageID **pids);
+void putBucket(Reln r, Count n, Page *pages, PageID *pids, Bool *changed);
+void countDeleted(Reln r, Count n);
+Count compactBucket(Reln r, PageID p);
+Count shrinkRelation(Reln r);
+Count growRelation(Reln r, Count npages);
+BTree attrIndex(Reln r, Count a);
+Bool staleIndex(Reln r, Count a);
+void buildIndex(Reln r, Count a);
+void dropIndex(Reln r, Count a);
+void reindexTuple(Reln r, Tuple old, Tuple t);
+BitmapIndex attrBitmap(Reln r, Count a);
+Bool staleBitmap(Reln r, Count a);
+void buildBitmap(Reln r, Count a);
+void dropBitmap(Reln r, Count a);
+Status addSignatures(Reln r, Count width, Count k);
+Count signatureWidth(Reln r, Count *k);
+Count scanSignatures(Reln r, Byte *query, PageID **match, Count *pages);
 
 PageID addToRelationSplitVersion(Reln r, Tuple t);
 
@@ -0,0 +1,78 @@
+// ring.c ... single-producer/single-consumer queues
+// part of Multi-attribute Linear-hashed Files
+// Lock-free: exactly one thread calls ringPut()/ringClose()
+//   and exactly one other thread calls ringGet()
+
+#define _POSIX_C_SOURCE 200112L
+#include <sched.h>
+#include "defs.h"
+#include "ring.h"
+
+// head and tail count items ever taken/added (they wrap around
+//   as unsigned ints, so tail-head is always the #items queued)
+// each is written by only one side, and sits on its own cache line
+// a full/empty queue makes the waiting side yield the CPU
+
+struct RingRep {
+	Count  size;      // #slots, a power of two
+	void **slot;      // the items
+	char   pad0[64];
+	Count  head;      // next item to take (consumer)
+	char   pad1[64];
+	Count  tail;      // next free slot (producer)
+	int    closed;    // producer has finished
+	char   pad2[64];
+};
+
+Ring newRing(Count size)
+{
+	Count n = 1;
+	while (n < size) n <<= 1;
+	Ring q = calloc(1, sizeof(struct RingRep));
+	assert(q != NULL);
+	q->slot = malloc(n * sizeof(void *));
+	assert(q->slot != NULL);
+	q->size = n;
+	return q;
+}
+
+void freeRing(Ring q)
+{
+	free(q->slot);
+	free(q);
+}
+
+// add an item; waits while the queue is full
+
+void ringPut(Ring q, void *item)
+{
+	Count tail = q->tail;
+	while (tail - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == q->size)
+		sched_yield();
+	q->slot[tail & (q->size-1)] = item;
+	__atomic_store_n(&q->tail, tail+1, __ATOMIC_RELEASE);
+}
+
+// take the next item; waits while the queue is empty
+// returns NULL once the queue is closed and drained
+
+void *ringGet(Ring q)
+{
+	Count head = q->head;
+	while (__atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == head) {
+		if (__atomic_load_n(&q->closed, __ATOMIC_ACQUIRE)
+		    && __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == head)
+			return NULL;
+		sched_yield();
+	}
+	void *item = q->slot[head & (q->size-1)];
+	__atomic_store_n(&q->head, head+1, __ATOMIC_RELEASE);
+	return item;
+}
+
+// producer has no more items
+
+void ringClose(Ring q)
+{
+	__atomic_store_n(&q->closed, 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,19 @@
+// ring.h ... interface to single-producer/single-consumer queues
+// part of Multi-attribute Linear-hashed Files
+// A Ring is a bounded queue of pointers between two threads
+// See ring.c for details on functions
+
+#ifndef RING_H
+#define RING_H 1
+
+#include "defs.h"
+
+typedef struct RingRep *Ring;
+
+Ring newRing(Count size);
+void freeRing(Ring q);
+void ringPut(Ring q, void *item);
+void *ringGet(Ring q);
+void ringClose(Ring q);
+
+#endif
@@ -0,0 +1,503 @@
+// roaring.c ... compressed bitmaps and bitmap indexes
+// part of Multi-attribute Linear-hashed Files
+// A chunk (container, in Roaring's terms) with up to ARRAYMAX
+//   slots keeps them as a sorted array of 16-bit values (2 bytes
+//   each); past that, a bitmap of 2^16 bits (8KB) is smaller
+// ANDs and ORs go chunk by chunk: bitmap with bitmap a word at a
+//   time, array with bitmap by probing the bitmap, and array with
+//   array by merging
+// An index file holds its Header, then a directory of (key,
+//   where its bitmap is), sorted by key, then the bitmaps, then
+//   (key,slot) pairs added since it was built, to the end of the
+//   file; rebuilding folds them into the bitmaps
+// Adds take an exclusive lock on the whole file, lookups a
+//   shared one, so an index can be shared between processes
+
+#include "defs.h"
+#include "roaring.h"
+#include "lock.h"
+
+#define CHUNKS   (1 << (SLOTBITS-16))
+#define ARRAYMAX 4096
+#define WORDS    (65536/64)
+#define BMMAGIC  0x424d7231  // "1rMB"
+#define PAIRS    512         // pairs read at a time
+
+typedef unsigned long long Word;
+
+// n of a chunk's 2^16 slots, in array[] (sorted, with room for
+// size) while n <= ARRAYMAX, and in words[] after that
+typedef struct {
+	Count n;
+	Count size;
+	unsigned short *array;
+	Word *words;
+} Chunk;
+
+struct BitmapRep {
+	Chunk c[CHUNKS];
+};
+
+struct BitmapIndexRep {
+	FILE *f;
+};
+
+typedef struct {
+	Count  magic;
+	Bits   stamp;  // as given to newBitmapIndex()
+	Count  nkeys;  // in the directory
+	Offset end;    // where the pairs added since it was built start
+} Header;
+
+typedef struct {
+	Bits   key;
+	Offset off;    // of its bitmap, as written by saveBitmap()
+	Count  len;    // #bytes
+} DirEntry;
+
+static void chunkAdd(Chunk *c, unsigned short v);
+static void toWords(Chunk *c);
+static Count popWords(Word *w);
+static Count savedBytes(Bitmap b);
+static void saveBitmap(Bitmap b, Byte *buf);
+static Bitmap loadBitmap(Byte *buf, Count len);
+static void readHeader(BitmapIndex x, Header *h);
+static Count pagesSpanned(Offset off, Offset len);
+
+Bitmap newBitmap(void)
+{
+	Bitmap b = calloc(1, sizeof(struct BitmapRep));
+	assert(b != NULL);
+	return b;
+}
+
+void freeBitmap(Bitmap b)
+{
+	for (Count i = 0; i < CHUNKS; i++) {
+		free(b->c[i].array);
+		free(b->c[i].words);
+	}
+	free(b);
+}
+
+void bitmapAdd(Bitmap b, Bits slot)
+{
+	assert(slot < (1u << SLOTBITS));
+	chunkAdd(&b->c[slot >> 16], slot & 0xffff);
+}
+
+static void chunkAdd(Chunk *c, unsigned short v)
+{
+	if (c->words != NULL) {
+		Word bit = 1ULL << (v % 64);
+		if (!(c->words[v/64] & bit)) c->n++;
+		c->words[v/64] |= bit;
+		return;
+	}
+	// where v goes in the array
+	Count lo = 0, hi = c->n;
+	while (lo < hi) {
+		Count mid = (lo + hi) / 2;
+		if (c->array[mid] < v) lo = mid + 1;
+		else hi = mid;
+	}
+	if (lo < c->n && c->array[lo] == v) return;
+	if (c->n == ARRAYMAX) {
+		toWords(c);
+		chunkAdd(c, v);
+		return;
+	}
+	if (c->n == c->size) {
+		c->size = (c->size == 0) ? 4 : 2*c->size;
+		c->array = realloc(c->array, c->size*sizeof(unsigned short));
+		assert(c->array != NULL);
+	}
+	memmove(&c->array[lo+1], &c->array[lo], (c->n-lo)*sizeof(unsigned short));
+	c->array[lo] = v;
+	c->n++;
+}
+
+// switch a chunk from an array to a bitmap
+
+static void toWords(Chunk *c)
+{
+	c->words = calloc(WORDS, sizeof(Word));
+	assert(c->words != NULL);
+	for (Count i = 0; i < c->n; i++)
+		c->words[c->array[i]/64] |= 1ULL << (c->array[i] % 64);
+	free(c->array);
+	c->array = NULL;
+	c->size = 0;
+}
+
+static Count popWords(Word *w)
+{
+	Count n = 0;
+	for (Count i = 0; i < WORDS; i++) n += __builtin_popcountll(w[i]);
+	return n;
+}
+
+// a |= b
+
+void bitmapOr(Bitmap a, Bitmap b)
+{
+	for (Count i = 0; i < CHUNKS; i++) {
+		Chunk *x = &a->c[i], *y = &b->c[i];
+		if (y->n == 0) continue;
+		if (x->words == NULL && (y->words != NULL || x->n + y->n > ARRAYMAX))
+			toWords(x);
+		if (x->words != NULL) {
+			if (y->words != NULL) {
+				for (Count w = 0; w < WORDS; w++) x->words[w] |= y->words[w];
+				x->n = popWords(x->words);
+			}
+			else
+				for (Count j = 0; j < y->n; j++) chunkAdd(x, y->array[j]);
+			continue;
+		}
+		// merge the arrays (from the end, in place)
+		if (x->size < x->n + y->n) {
+			x->size = x->n + y->n;
+			x->array = realloc(x->array, x->size*sizeof(unsigned short));
+			assert(x->array != NULL);
+		}
+		int p = x->n - 1, q = y->n - 1, k = x->n + y->n - 1;
+		while (q >= 0) {
+			if (p >= 0 && x->array[p] > y->array[q])
+				x->array[k--] = x->array[p--];
+			else
+				x->array[k--] = y->array[q--];
+		}
+		// then drop the repeats
+		Count n = 0;
+		for (Count j = 0; j < x->n + y->n; j++)
+			if (n == 0 || x->array[j] != x->array[n-1]) x->array[n++] = x->array[j];
+		x->n = n;
+	}
+}
+
+// a &= b
+
+void bitmapAnd(Bitmap a, Bitmap b)
+{
+	for (Count i = 0; i < CHUNKS; i++) {
+		Chunk *x = &a->c[i], *y = &b->c[i];
+		Count n = 0, j, k;
+		if (x->n == 0) continue;
+		if (x->words != NULL && y->words != NULL) {
+			for (Count w = 0; w < WORDS; w++) x->words[w] &= y->words[w];
+			x->n = popWords(x->words);
+			continue;
+		}
+		if (x->words != NULL) {
+			// y's values that x has, as x's new array
+			unsigned short *v = malloc((y->n + 1)*sizeof(unsigned short));
+			assert(v != NULL);
+			for (j = 0; j < y->n; j++)
+				if (x->words[y->array[j]/64] & (1ULL << (y->array[j] % 64)))
+					v[n++] = y->array[j];
+			free(x->words);
+			x->words = NULL;
+			x->array = v;
+			x->size = y->n + 1;
+		}
+		else if (y->words != NULL) {
+			for (j = 0; j < x->n; j++)
+				if (y->words[x->array[j]/64] & (1ULL << (x->array[j] % 64)))
+					x->array[n++] = x->array[j];
+		}
+		else {
+			for (j = k = 0; j < x->n && k < y->n; ) {
+				if (x->array[j] < y->array[k]) j++;
+				else if (x->array[j] > y->array[k]) k++;
+				else {
+					x->array[n++] = x->array[j];
+					j++;  k++;
+				}
+			}
+		}
+		x->n = n;
+	}
+}
+
+Count bitmapCount(Bitmap b)
+{
+	Count n = 0;
+	for (Count i = 0; i < CHUNKS; i++) n += b->c[i].n;
+	return n;
+}
+
+// b's slots, in order, into *slots (to be freed); returns how many
+
+Count bitmapSlots(Bitmap b, Bits **slots)
+{
+	Bits *s = malloc((bitmapCount(b) + 1)*sizeof(Bits));
+	assert(s != NULL);
+	Count n = 0;
+	for (Count i = 0; i < CHUNKS; i++) {
+		Chunk *c = &b->c[i];
+		if (c->words == NULL) {
+			for (Count j = 0; j < c->n; j++) s[n++] = i << 16 | c->array[j];
+			continue;
+		}
+		for (Count w = 0; w < WORDS; w++)
+			for (Word bits = c->words[w]; bits != 0; bits &= bits - 1)
+				s[n++] = i << 16 | (w*64 + __builtin_ctzll(bits));
+	}
+	*slots = s;
+	return n;
+}
+
+// a bitmap in a file is the #chunks it has slots in, then for
+// each, its number and #slots, then its array or its words
+
+static Count savedBytes(Bitmap b)
+{
+	Count bytes = sizeof(Count);
+	for (Count i = 0; i < CHUNKS; i++) {
+		Chunk *c = &b->c[i];
+		if (c->n == 0) continue;
+		bytes += 2*sizeof(Count);
+		bytes += (c->n <= ARRAYMAX) ? c->n*sizeof(unsigned short) : WORDS*sizeof(Word);
+	}
+	return bytes;
+}
+
+static void saveBitmap(Bitmap b, Byte *buf)
+{
+	Count n = 0;
+	Byte *p = buf + sizeof(Count);
+	for (Count i = 0; i < CHUNKS; i++) {
+		Chunk *c = &b->c[i];
+		if (c->n == 0) continue;
+		n++;
+		memcpy(p, &i, sizeof(Count));
+		memcpy(p + sizeof(Count), &c->n, sizeof(Count));
+		p += 2*sizeof(Count);
+		if (c->n > ARRAYMAX) {
+			memcpy(p, c->words, WORDS*sizeof(Word));
+			p += WORDS*sizeof(Word);
+			continue;
+		}
+		if (c->words != NULL) {
+			// (emptied by an AND down to an array's worth)
+			for (Count w = 0; w < WORDS; w++)
+				for (Word bits = c->words[w]; bits != 0; bits &= bits - 1) {
+					unsigned short v = w*64 + __builtin_ctzll(bits);
+					memcpy(p, &v, sizeof(unsigned short));
+					p += sizeof(unsigned short);
+				}
+		}
+		else {
+			memcpy(p, c->array, c->n*sizeof(unsigned short));
+			p += c->n*sizeof(unsigned short);
+		}
+	}
+	memcpy(buf, &n, sizeof(Count));
+}
+
+static Bitmap loadBitmap(Byte *buf, Count len)
+{
+	Bitmap b = newBitmap();
+	Count n, i, k;
+	Byte *p = buf + sizeof(Count);
+	memcpy(&n, buf, sizeof(Count));
+	for (k = 0; k < n; k++) {
+		memcpy(&i, p, sizeof(Count));
+		assert(i < CHUNKS);
+		Chunk *c = &b->c[i];
+		memcpy(&c->n, p + sizeof(Count), sizeof(Count));
+		p += 2*sizeof(Count);
+		if (c->n > ARRAYMAX) {
+			c->words = malloc(WORDS*sizeof(Word));
+			assert(c->words != NULL);
+			memcpy(c->words, p, WORDS*sizeof(Word));
+			p += WORDS*sizeof(Word);
+		}
+		else {
+			c->size = c->n;
+			c->array = malloc(c->n*sizeof(unsigned short));
+			assert(c->array != NULL);
+			memcpy(c->array, p, c->n*sizeof(unsigned short));
+			p += c->n*sizeof(unsigned short);
+		}
+	}
+	assert(p == buf + len);
+	return b;
+}
+
+// make an index in file fname holding pairs[0..n-1], each a key
+// (upper 32 bits) and a slot, sorted, and open it for changes
+// stamp is kept with it, for the user to check it against later
+
+BitmapIndex newBitmapIndex(char *fname, Bits stamp, unsigned long long *pairs, Count n)
+{
+	FILE *f = fopen(fname, "w+");
+	if (f == NULL) return NULL;
+	setvbuf(f, NULL, _IONBF, 0);
+	BitmapIndex x = malloc(sizeof(struct BitmapIndexRep));
+	assert(x != NULL);
+	x->f = f;
+
+	Count nkeys = 0, i, j;
+	for (i = 0; i < n; i++)
+		if (i == 0 || pairs[i] >> 32 != pairs[i-1] >> 32) nkeys++;
+	DirEntry *dir = malloc((nkeys + 1)*sizeof(DirEntry));
+	assert(dir != NULL);
+	Offset off = sizeof(Header) + nkeys*sizeof(DirEntry);
+	fseek(f, off, SEEK_SET);
+	Count k = 0;
+	for (i = 0; i < n; i = j) {
+		Bitmap b = newBitmap();
+		for (j = i; j < n && pairs[j] >> 32 == pairs[i] >> 32; j++)
+			bitmapAdd(b, (Bits)pairs[j]);
+		dir[k].key = pairs[i] >> 32;
+		dir[k].off = off;
+		dir[k].len = savedBytes(b);
+		Byte *buf = malloc(dir[k].len);
+		assert(buf != NULL);
+		saveBitmap(b, buf);
+		int ok = fwrite(buf, dir[k].len, 1, f);
+		assert(ok == 1);
+		off += dir[k].len;
+		free(buf);
+		freeBitmap(b);
+		k++;
+	}
+	Header h = { BMMAGIC, stamp, nkeys, off };
+	fseek(f, 0, SEEK_SET);
+	int ok = fwrite(&h, sizeof(Header), 1, f);
+	assert(ok == 1);
+	if (nkeys > 0) {
+		ok = fwrite(dir, sizeof(DirEntry), nkeys, f);
+		assert(ok == nkeys);
+	}
+	free(dir);
+	return x;
+}
+
+// open an existing index ("r", or "r+" to change it);
+// NULL if there isn't one
+
+BitmapIndex openBitmapIndex(char *fname, char *mode)
+{
+	FILE *f = fopen(fname, mode);
+	if (f == NULL) return NULL;
+	setvbuf(f, NULL, _IONBF, 0);
+	BitmapIndex x = malloc(sizeof(struct BitmapIndexRep));
+	assert(x != NULL);
+	x->f = f;
+	return x;
+}
+
+void closeBitmapIndex(BitmapIndex x)
+{
+	fclose(x->f);
+	free(x);
+}
+
+FILE *bitmapIndexFile(BitmapIndex x) { return x->f; }
+
+Bits bitmapIndexStamp(BitmapIndex x)
+{
+	Header h;
+	readHeader(x, &h);
+	return h.stamp;
+}
+
+// #keys in the directory, #pairs added since, and #pages
+
+Count bitmapIndexSize(BitmapIndex x, Count *added, Count *pages)
+{
+	Header h;
+	lockRange(x->f, 0, 0, LOCK_SHARED, TRUE);
+	readHeader(x, &h);
+	fseek(x->f, 0, SEEK_END);
+	long size = ftell(x->f);
+	unlockRange(x->f, 0, 0);
+	*added = (size - h.end) / (2*sizeof(Bits));
+	*pages = (size + PAGESIZE-1) / PAGESIZE;
+	return h.nkeys;
+}
+
+// add slot to key's bitmap
+
+void bitmapIndexAdd(BitmapIndex x, Bits key, Bits slot)
+{
+	Bits pair[2] = { key, slot };
+	lockRange(x->f, 0, 0, LOCK_EXCL, TRUE);
+	fseek(x->f, 0, SEEK_END);
+	int ok = fwrite(pair, sizeof(pair), 1, x->f);
+	assert(ok == 1);
+	unlockRange(x->f, 0, 0);
+}
+
+// the slots in the bitmaps of any of keys[0..nkeys-1] (to be
+// freed); adds the #pages read to *pages
+
+Bitmap bitmapIndexLookup(BitmapIndex x, Bits *keys, Count nkeys, Count *pages)
+{
+	Header h;
+	Bitmap b = newBitmap();
+	Count i, j;
+	lockRange(x->f, 0, 0, LOCK_SHARED, TRUE);
+	readHeader(x, &h);
+	DirEntry *dir = malloc((h.nkeys + 1)*sizeof(DirEntry));
+	assert(dir != NULL);
+	if (h.nkeys > 0) {
+		int ok = fread(dir, sizeof(DirEntry), h.nkeys, x->f);
+		assert(ok == h.nkeys);
+	}
+	*pages += pagesSpanned(0, sizeof(Header) + h.nkeys*sizeof(DirEntry));
+	for (i = 0; i < nkeys; i++) {
+		Count lo = 0, hi = h.nkeys;
+		while (lo < hi) {
+			Count mid = (lo + hi) / 2;
+			if (dir[mid].key < keys[i]) lo = mid + 1;
+			else hi = mid;
+		}
+		if (lo == h.nkeys || dir[lo].key != keys[i]) continue;
+		Byte *buf = malloc(dir[lo].len);
+		assert(buf != NULL);
+		fseek(x->f, dir[lo].off, SEEK_SET);
+		int ok = fread(buf, dir[lo].len, 1, x->f);
+		assert(ok == 1);
+		*pages += pagesSpanned(dir[lo].off, dir[lo].len);
+		Bitmap kb = loadBitmap(buf, dir[lo].len);
+		bitmapOr(b, kb);
+		freeBitmap(kb);
+		free(buf);
+	}
+	free(dir);
+
+	// and the pairs added since
+	Bits pairs[2*PAIRS];
+	Count n, bytes = 0;
+	fseek(x->f, h.end, SEEK_SET);
+	while ((n = fread(pairs, 2*sizeof(Bits), PAIRS, x->f)) > 0) {
+		for (j = 0; j < n; j++)
+			for (i = 0; i < nkeys; i++)
+				if (pairs[2*j] == keys[i]) bitmapAdd(b, pairs[2*j+1]);
+		bytes += n*2*sizeof(Bits);
+	}
+	*pages += pagesSpanned(h.end, bytes);
+	unlockRange(x->f, 0, 0);
+	return b;
+}
+
+// reads the Header, leaving the file at the directory
+
+static void readHeader(BitmapIndex x, Header *h)
+{
+	fseek(x->f, 0, SEEK_SET);
+	int n = fread(h, sizeof(Header), 1, x->f);
+	assert(n == 1 && h->magic == BMMAGIC);
+}
+
+// #pages holding the len bytes from off
+
+static Count pagesSpanned(Offset off, Offset len)
+{
+	if (len == 0) return 0;
+	return (off + len - 1) / PAGESIZE - off / PAGESIZE + 1;
+}
@@ -0,0 +1,41 @@
+// roaring.h ... interface to compressed bitmaps and bitmap indexes
+// part of Multi-attribute Linear-hashed Files
+// A Bitmap is a set of hash slots (the lower SLOTBITS bits of
+//   tuples' hashes), compressed as in Roaring bitmaps: the slots
+//   are split into chunks of 2^16 by their upper bits, and each
+//   chunk holds its lower 16 bits in a sorted array while there
+//   are few of them, or in a plain bitmap once there are many
+// A BitmapIndex maps keys (e.g. the hashes of an attribute's
+//   values) to Bitmaps, in a file: a directory of keys and their
+//   bitmaps, as built, then the (key,slot) pairs added since
+// See roaring.c for details on functions
+
+#ifndef ROARING_H
+#define ROARING_H 1
+
+#include "defs.h"
+#include "bits.h"
+
+#define SLOTBITS 20  // bits of a slot; 2^(SLOTBITS-16) chunks
+
+typedef struct BitmapRep *Bitmap;
+typedef struct BitmapIndexRep *BitmapIndex;
+
+Bitmap newBitmap(void);
+void freeBitmap(Bitmap b);
+void bitmapAdd(Bitmap b, Bits slot);
+void bitmapOr(Bitmap a, Bitmap b);
+void bitmapAnd(Bitmap a, Bitmap b);
+Count bitmapCount(Bitmap b);
+Count bitmapSlots(Bitmap b, Bits **slots);
+
+BitmapIndex newBitmapIndex(char *fname, Bits stamp, unsigned long long *pairs, Count n);
+BitmapIndex openBitmapIndex(char *fname, char *mode);
+void closeBitmapIndex(BitmapIndex x);
+FILE *bitmapIndexFile(BitmapIndex x);
+Bits bitmapIndexStamp(BitmapIndex x);
+Count bitmapIndexSize(BitmapIndex x, Count *added, Count *pages);
+void bitmapIndexAdd(BitmapIndex x, Bits key, Bits slot);
+Bitmap bitmapIndexLookup(BitmapIndex x, Bits *keys, Count nkeys, Count *pages);
+
+#endif
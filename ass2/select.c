@@ -1,16 +1,42 @@
 // select.c ... run queries
 // part of Multi-attribute linear-hashed files
 // Ask a query on a named relation
-// Usage:  ./select  [-v]  RelName  v1,v2,v3,v4,...
-// where any of the vi's can be "?" (unknown)
+// Usage:  ./select  [-v]  [--explain]  [--limit N]  [--count]  [--sample P]
+//                  RelName  v1,v2,v3,v4,...
+//         ./select  [-v]  [--explain]  --keys  RelName  <  Keys
+// where any of the vi's can be "?" (unknown), or a list of values
+//   separated by "|" (e.g. "a|b|c") any of which matches, or a
+//   range of ints "lo..hi" (either end can be left out), which
+//   only reads some of the buckets if the attribute is ordered
+//   (see create)
+// --explain shows which buckets the query will read, and about
+//   how many pages that is, then how many it actually read
+//   (the buckets come from a secondary index instead, if there's
+//   one on an attribute the query knows that reads fewer pages,
+//   see index.c; or from ANDing the bitmap indexes on attributes
+//   it knows, see bitmap.c; or from scanning the relation's
+//   signatures, if it has them and that's expected to read
+//   fewer, see create.c)
+// --limit stops once N matching tuples have been found
+// --count just shows how many tuples match (up to N, with --limit)
+// --sample reads a random P% of the hash slots the query could
+//   match, shows the matches in them, then an estimate of the
+//   #matches in the whole relation (or just the estimate, with
+//   --count), with its 95% confidence interval
+// --keys looks up each line of Keys, which holds values for the
+//   relation's key attributes (see create), in order, separated
+//   by commas; -v reports keys that aren't there
 
+#include <time.h>
 #include "defs.h"
 #include "query.h"
 #include "tuple.h"
 #include "reln.h"
 #include "chvec.h"
 
-#define USAGE "./select  [-v]  RelName  v1,v2,v3,v4,..."
+#define USAGE "./select  [-v]  [--explain]  [--limit N]  [--count]  [--sample P]  [--keys]  RelName  [v1,v2,v3,v4,...]"
+
+static void lookupKeys(Reln r, int verbose, int explain);
 
 // Main ... process args, run query
 
@@ -21,20 +47,44 @@ int main(int argc, char **argv)
 	Tuple t;  // tuple pointer
 	char err[MAXERRMSG];  // buffer for error messages
 	int verbose;  // show extra info on query progress
+	int explain;  // show the plan, and what it cost
+	int keys;     // look up keys from stdin
+	int limit;    // most tuples to find (0 for all of them)
+	int count;    // show #matches instead of the tuples
+	double sample; // % of the relation to read (0 for all of it)
 	char *rname;  // name of table/file
 	char *qstr;   // query string
 
 	// process command-line args
 
 	if (argc < 3) fatal(USAGE);
-	if (strcmp(argv[1], "-v") == 0) {
-		verbose = 1;  rname = argv[2];  qstr = argv[3];
-	}
-	else {
-		verbose = 0;  rname = argv[1];  qstr = argv[2];
+	int arg = 1;
+	verbose = explain = keys = limit = count = 0;
+	sample = 0;
+	while (arg < argc && argv[arg][0] == '-') {
+		if (strcmp(argv[arg], "-v") == 0)
+			verbose = 1;
+		else if (strcmp(argv[arg], "--explain") == 0)
+			explain = 1;
+		else if (strcmp(argv[arg], "--keys") == 0)
+			keys = 1;
+		else if (strcmp(argv[arg], "--limit") == 0 && arg+1 < argc) {
+			limit = atoi(argv[++arg]);
+			if (limit < 1) fatal(USAGE);
+		}
+		else if (strcmp(argv[arg], "--count") == 0)
+			count = 1;
+		else if (strcmp(argv[arg], "--sample") == 0 && arg+1 < argc) {
+			sample = atof(argv[++arg]);
+			if (sample <= 0 || sample > 100) fatal(USAGE);
+		}
+		else
+			fatal(USAGE);
+		arg++;
 	}
-
-	if (verbose) { /* keeps compiler quiet */ }
+	if (argc - arg < (keys ? 1 : 2)) fatal(USAGE);
+	if (sample > 0 && (limit > 0 || keys)) fatal(USAGE);
+	rname = argv[arg];  qstr = argv[arg+1];
 
 	// initialise relation and scanning structure
 
@@ -46,18 +96,48 @@ int main(int argc, char **argv)
 		sprintf(err, "Can't open relation: %s",rname);
 		fatal(err);
 	}
+	if (keys) {
+		lookupKeys(r, verbose, explain);
+		closeRelation(r);
+		return 0;
+	}
 	if ((q = startQuery(r, qstr)) == NULL) {	
 		sprintf(err, "Invalid query: %s",qstr);
 		fatal(err);
 	}
 
+	if (explain) explainQuery(q);
+	if (sample > 0) sampleQuery(q, sample/100, (unsigned)time(NULL));
+
 	// execute the query (find matching tuples)
 	// bug, not free
 	char tup[MAXTUPLEN];
-	while ((t = getNextTuple(q)) != NULL) {
+	Count nfound = 0;
+	if (count) {
+		nfound = countMatches(q, limit);
+		if (sample == 0) printf("%d\n", nfound);
+	}
+	while (!count && (limit == 0 || nfound < limit)
+	       && (t = getNextTuple(q)) != NULL) {
 		tupleString(t,tup);
 		printf("%s\n",tup);
 		free(t);
+		nfound++;
+	}
+	if (sample > 0) {
+		double est, half;
+		Count nslots, allslots;
+		sampleEstimate(q, &est, &half);
+		sampleSize(q, &nslots, &allslots);
+		double lo = (est - half < nfound) ? nfound : est - half;
+		printf("~%.0f matches (95%% CI %.0f..%.0f), from %d of %d hash slots\n",
+		       est, lo, est + half, nslots, allslots);
+	}
+	if (explain) {
+		Count npg, ntup;
+		queryCounts(q, &npg, &ntup);
+		printf("pages read: %d, tuples examined: %d, matched: %d\n",
+		       npg, ntup, nfound);
 	}
 
 	// clean up
@@ -68,3 +148,54 @@ int main(int argc, char **argv)
 	return 0;
 }
 
+
+// one query per key in stdin, binding the key attributes and
+// leaving the rest unknown, so each stops at its one match
+
+static void lookupKeys(Reln r, int verbose, int explain)
+{
+	char line[MAXTUPLEN+2];  // key values from stdin
+	char qstr[MAXTUPLEN+2*MAXATTRS];  // query made from them
+	char tup[MAXTUPLEN];  // printable tuple
+	char *vals[MAXATTRS];  // values in the line
+	Bits key = keyAttrs(r);
+	Count nkeys = 0, nfound = 0, pages = 0, tuples = 0;
+
+	if (key == 0) fatal("Relation has no key");
+	while (fgets(line, MAXTUPLEN+2, stdin) != NULL) {
+		line[strcspn(line, "\n")] = '\0';
+		if (line[0] == '\0') continue;
+		Count n = 0;
+		for (char *v = strtok(line, ","); v != NULL; v = strtok(NULL, ","))
+			if (n++ < MAXATTRS) vals[n-1] = v;
+		if (n != countBits(key)) {
+			fprintf(stderr, "Skipping invalid key\n");
+			continue;
+		}
+		qstr[0] = '\0';
+		for (Count i = 0, k = 0; i < nattrs(r); i++) {
+			if (i > 0) strcat(qstr, ",");
+			strcat(qstr, bitAt(key, i) ? vals[k++] : "?");
+		}
+
+		Query q = startQuery(r, qstr);
+		assert(q != NULL);
+		Tuple t = getNextTuple(q);
+		if (t != NULL) {
+			tupleString(t,tup);
+			printf("%s\n",tup);
+			free(t);
+			nfound++;
+		}
+		else if (verbose)
+			fprintf(stderr, "%s: not found\n", qstr);
+		Count npg, ntup;
+		queryCounts(q, &npg, &ntup);
+		pages += npg;  tuples += ntup;
+		nkeys++;
+		closeQuery(q);
+	}
+	if (explain)
+		printf("keys: %d, found: %d, pages read: %d, tuples examined: %d\n",
+		       nkeys, nfound, pages, tuples);
+}
@@ -0,0 +1,86 @@
+// sig.c ... signature files
+// part of Multi-attribute Linear-hashed Files
+// The k bits of a value are g, g+g2, g+2*g2, ... (mod width)
+//   (double hashing, as for Bloom filters) where g and g2 come
+//   from re-mixing its hash with its attribute#, so the same
+//   value in different attributes sets different bits
+// Scans compare signatures a vector (SIGALIGN bytes) at a time,
+//   using GCC's vector extensions, which compile to whatever
+//   SIMD instructions the target has
+
+#include <math.h>
+#include "defs.h"
+#include "sig.h"
+#include "hash.h"
+
+#define SIGLANES (SIGALIGN/sizeof(unsigned long long))
+#define SIGCHUNK 1024  // vectors read from the file at a time
+
+typedef unsigned long long SigVec __attribute__((vector_size(SIGALIGN)));
+
+// can signatures be this wide, with k bits per value?
+
+Bool sigValid(Count width, Count k)
+{
+	return width > 0 && width <= MAXSIGWIDTH && width % (8*SIGALIGN) == 0
+	       && k > 0 && k <= width/8;
+}
+
+// add the value (with this hash) of attribute attr to sig
+
+void sigAdd(Byte *sig, Count width, Count k, Count attr, Bits hash)
+{
+	Bits g = fmix32(hash ^ fmix32(attr + 1));
+	Bits g2 = (g >> 16) | 1;
+	for (Count i = 0; i < k; i++, g += g2) {
+		Bits bit = g % width;
+		sig[bit/8] |= 1 << (bit%8);
+	}
+}
+
+// the numbers of the signatures in f that have all of query's
+// bits, into *match (to be freed), reading to the end of the file
+// adds the #pages of f read to *pages
+
+Count sigScan(FILE *f, Count width, Byte *query, PageID **match, Count *pages)
+{
+	static SigVec buf[SIGCHUNK];
+	SigVec q[MAXSIGWIDTH/(8*SIGALIGN)];
+	Count nv = width/(8*SIGALIGN);  // vectors in each signature
+	Count per = SIGCHUNK/nv;        // signatures in each read
+	Count n = 0, size = 64, s = 0, got, i, j;
+	unsigned long long bytes = SIGHDR;
+	PageID *m = malloc(size*sizeof(PageID));
+	assert(m != NULL);
+	memcpy(q, query, width/8);
+	fseek(f, SIGHDR, SEEK_SET);
+	while ((got = fread(buf, width/8, per, f)) > 0) {
+		for (i = 0; i < got; i++, s++) {
+			// bits of the query that the signature lacks
+			SigVec lack = q[0] & ~buf[i*nv];
+			for (j = 1; j < nv; j++) lack |= q[j] & ~buf[i*nv+j];
+			unsigned long long any = 0;
+			for (j = 0; j < SIGLANES; j++) any |= lack[j];
+			if (any != 0) continue;
+			if (n == size) {
+				size *= 2;
+				m = realloc(m, size*sizeof(PageID));
+				assert(m != NULL);
+			}
+			m[n++] = s;
+		}
+		bytes += got*width/8;
+	}
+	*pages += (bytes + PAGESIZE-1) / PAGESIZE;
+	*match = m;
+	return n;
+}
+
+// chance that a signature holding this many values has all of
+// qbits bits that aren't from any of them
+
+double sigFalseMatch(Count width, Count k, double values, Count qbits)
+{
+	double set = 1 - pow(1 - 1.0/width, k*values);
+	return pow(set, qbits);
+}
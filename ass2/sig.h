@@ -0,0 +1,37 @@
+// sig.h ... interface to signature files
+// part of Multi-attribute Linear-hashed Files
+// A relation can have a signature file, R.sig, holding one
+//   superimposed codeword signature for each bucket: each value
+//   of each tuple in the bucket sets k of its width bits, chosen
+//   by the value's hash and its attribute
+// A query's signature has the bits of the values it knows; only
+//   buckets whose signatures have all of them can hold a match,
+//   and they're found by scanning the whole (small) file
+// Signatures only gain bits as tuples are added; they're rebuilt
+//   when a bucket's tuples are rearranged
+// See sig.c for details on functions
+
+#ifndef SIG_H
+#define SIG_H 1
+
+#include "defs.h"
+#include "bits.h"
+
+#define SIGMAGIC    0x53696731  // "1giS"
+#define SIGALIGN    32    // bytes in a vector; widths are multiples
+#define SIGHDR      64    // bytes before the first signature
+#define MAXSIGWIDTH 4096  // bits
+
+// what's in the first SIGHDR bytes of R.sig
+typedef struct {
+	Count magic;
+	Count width;  // bits in each signature
+	Count k;      // bits each value sets
+} SigHeader;
+
+Bool sigValid(Count width, Count k);
+void sigAdd(Byte *sig, Count width, Count k, Count attr, Bits hash);
+Count sigScan(FILE *f, Count width, Byte *query, PageID **match, Count *pages);
+double sigFalseMatch(Count width, Count k, double values, Count qbits);
+
+#endif
@@ -0,0 +1,147 @@
+// sketch.c ... per-attribute statistics
+// part of Multi-attribute Linear-hashed Files
+// Values are identified by their hash (from the relation's hash
+//   function), which is mixed again before the HyperLogLog uses
+//   it, so weaker hash functions still give good estimates
+// An all-zero AttrStats is empty
+
+#include <math.h>
+#include "defs.h"
+#include "sketch.h"
+#include "hash.h"
+
+#define NREGS (1 << HLLBITS)
+
+static void addTop(AttrStats *s, Bits hash, char *val, Count count, Count err);
+
+// add one value, whose hash is given
+
+void statsAdd(AttrStats *s, char *val, Bits hash)
+{
+	s->nvals++;
+	s->bytes += strlen(val);
+
+	// register from the top bits, rank of the first 1 in the rest
+	Bits h = fmix32(hash);
+	Bits reg = h >> (MAXBITS - HLLBITS);
+	Bits rest = h << HLLBITS;
+	Byte rank = (rest == 0) ? MAXBITS - HLLBITS + 1 : __builtin_clz(rest) + 1;
+	if (rank > s->hll[reg]) s->hll[reg] = rank;
+
+	addTop(s, hash, val, 1, 0);
+}
+
+// count a value (or count more of it) in the Space-Saving summary
+// when it's full, a new value takes over the least counted slot,
+//   inheriting its count as possible error
+
+static void addTop(AttrStats *s, Bits hash, char *val, Count count, Count err)
+{
+	Count i, min = 0;
+	for (i = 0; i < s->ntop; i++) {
+		if (s->top[i].hash == hash) {
+			s->top[i].count += count;
+			s->top[i].err += err;
+			return;
+		}
+		if (s->top[i].count < s->top[min].count) min = i;
+	}
+	if (s->ntop < TOPSLOTS) {
+		i = s->ntop++;
+		s->top[i].count = count;
+		s->top[i].err = err;
+	}
+	else {
+		i = min;
+		s->top[i].err = s->top[i].count + err;
+		s->top[i].count += count;
+	}
+	s->top[i].hash = hash;
+	strncpy(s->top[i].val, val, TOPVALLEN-1);
+	s->top[i].val[TOPVALLEN-1] = '\0';
+}
+
+// add everything in 'from' to 'into'
+
+void statsMerge(AttrStats *into, AttrStats *from)
+{
+	into->nvals += from->nvals;
+	into->bytes += from->bytes;
+	for (Count i = 0; i < NREGS; i++)
+		if (from->hll[i] > into->hll[i]) into->hll[i] = from->hll[i];
+	for (Count i = 0; i < from->ntop; i++)
+		addTop(into, from->top[i].hash, from->top[i].val,
+		       from->top[i].count, from->top[i].err);
+}
+
+// estimated #distinct values
+// with the usual corrections when it's small (linear counting
+//   of empty registers) or near the limit of 32-bit hashes
+
+double statsDistinct(AttrStats *s)
+{
+	double m = NREGS, sum = 0;
+	Count zeros = 0;
+	for (Count i = 0; i < NREGS; i++) {
+		sum += ldexp(1.0, -s->hll[i]);
+		zeros += (s->hll[i] == 0);
+	}
+	double e = 0.7213/(1 + 1.079/m) * m * m / sum;
+	if (e <= 2.5*m && zeros > 0)
+		e = m * log(m/zeros);
+	else if (e > 4294967296.0/30)
+		e = -4294967296.0 * log(1 - e/4294967296.0);
+	return e;
+}
+
+double statsAvgLen(AttrStats *s)
+{
+	return (s->nvals == 0) ? 0 : (double)s->bytes / s->nvals;
+}
+
+// estimated fraction of the values that equal the one with this
+// hash: its own count if it's among the frequent ones, otherwise
+// an even share of what they leave over
+
+double statsFraction(AttrStats *s, Bits hash)
+{
+	if (s->nvals == 0) return 0;
+	Count inTop = 0;
+	for (Count i = 0; i < s->ntop; i++) {
+		if (s->top[i].hash == hash)
+			return (double)(s->top[i].count - s->top[i].err) / s->nvals;
+		inTop += s->top[i].count - s->top[i].err;
+	}
+	double others = statsDistinct(s) - s->ntop;
+	if (others < 1) others = 1;
+	return (s->nvals - inTop) / others / s->nvals;
+}
+
+// by #times certainly seen
+
+static int moreFrequent(const void *a, const void *b)
+{
+	const TopSlot *x = a, *y = b;
+	Count nx = x->count - x->err, ny = y->count - y->err;
+	return (nx < ny) - (nx > ny);
+}
+
+// one line: ~#distinct, average length, most frequent values
+// (only those certainly more than 1/TOPSLOTS of all the values,
+//   which Space-Saving never misses, with the #times certainly seen)
+
+void printAttrStats(AttrStats *s)
+{
+	TopSlot top[TOPSLOTS];
+	memcpy(top, s->top, s->ntop*sizeof(TopSlot));
+	qsort(top, s->ntop, sizeof(TopSlot), moreFrequent);
+	printf("~distinct:%.0f  avglen:%.1f  top:", statsDistinct(s), statsAvgLen(s));
+	Count shown = 0;
+	for (Count i = 0; i < s->ntop && shown < TOPSHOW; i++) {
+		if (top[i].count - top[i].err <= s->nvals/TOPSLOTS) break;
+		printf(" %s(%d)", top[i].val, top[i].count - top[i].err);
+		shown++;
+	}
+	if (shown == 0) printf(" (none stand out)");
+	putchar('\n');
+}
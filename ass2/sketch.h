@@ -0,0 +1,43 @@
+// sketch.h ... interface to per-attribute statistics
+// part of Multi-attribute Linear-hashed Files
+// An AttrStats summarises the values added to one attribute:
+//  - a HyperLogLog sketch, for the #distinct values
+//  - a Space-Saving summary of the most frequent values
+//  - the total length of the values, for their average length
+// Two AttrStats for the same attribute can be merged
+// See sketch.c for details on functions
+
+#ifndef SKETCH_H
+#define SKETCH_H 1
+
+#include "defs.h"
+#include "bits.h"
+
+#define HLLBITS  10   // 2^HLLBITS registers (about 3% error)
+#define TOPSLOTS 32   // values tracked as possibly frequent
+#define TOPSHOW  5    // how many of them are reported
+#define TOPVALLEN 24  // prefix of each value kept for display
+
+typedef struct {
+	Bits  hash;
+	Count count;  // over-estimate of #times seen
+	Count err;    // by at most this much
+	char  val[TOPVALLEN];
+} TopSlot;
+
+typedef struct {
+	Count   nvals;   // #values added
+	Count   ntop;    // #slots used in top[]
+	unsigned long long bytes;  // total length of the values
+	Byte    hll[1 << HLLBITS];
+	TopSlot top[TOPSLOTS];
+} AttrStats;
+
+void statsAdd(AttrStats *s, char *val, Bits hash);
+void statsMerge(AttrStats *into, AttrStats *from);
+double statsDistinct(AttrStats *s);
+double statsAvgLen(AttrStats *s);
+double statsFraction(AttrStats *s, Bits hash);
+void printAttrStats(AttrStats *s);
+
+#endif
@@ -23,7 +23,7 @@ int main(int argc, char **argv)
 	if (!existsRelation(relname))
 		fatal("No such relation\n");
 	Reln r = openRelation(relname,"r");
-	if (r == NULL) fatal("No such relation");
+	if (r == NULL) fatal("Can't open relation");
 
 	relationStats(r);
 	closeRelation(r);
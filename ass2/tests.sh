@@ -0,0 +1,89 @@
+#!/bin/sh
+# tests.sh ... checks of the tools on small relations
+# part of Multi-attribute linear-hashed files
+# Usage:  ./tests.sh   (after make; or make check)
+# Each check prints "ok" or "FAIL" and what it got; exits 1 if
+#   any failed
+# Relations are made as T.* in the current directory, and
+#   removed afterwards
+
+fail=0
+
+# check name expected actual
+check()
+{
+	if [ "$2" = "$3" ]
+	then echo "ok    $1"
+	else echo "FAIL  $1: expected \"$2\", got \"$3\""; fail=1
+	fi
+}
+
+# a choice vector with no bits from attribute 2
+CV01=$(i=0; while [ $i -lt 16 ]; do printf "0,$i:1,$i"; [ $i -lt 15 ] && printf ":"; i=$((i+1)); done)
+
+# an in-place update (attribute 2 has no bits in the choice
+# vector) must still reach the index on attribute 2
+rm -f T.*
+./create T 3 1 "$CV01" >/dev/null
+./gendata 300 3 5 | ./insert T >/dev/null
+./index T 2 >/dev/null
+t=$(./dump T | grep , | sed -n 10p)
+k=$(echo "$t" | cut -d, -f1)
+new=$(echo "$t" | cut -d, -f3 | sed 's/./Q/g')
+check "update in place" "Updated 1 tuples (0 moved)" \
+	"$(./update T "$k,?,?" "?,?,$new" | grep Updated)"
+check "select through index after update" "$(echo "$t" | cut -d, -f1,2),$new" \
+	"$(./select T "?,?,$new" | grep ,)"
+check "index used" "index on attribute 2: 1 hashes, in 1 buckets" \
+	"$(./select --explain --count T "?,?,$new" | grep "index on")"
+
+# ... and so must the bitmap index on attribute 2
+./index --drop T 2 >/dev/null
+./bitmap T 2 >/dev/null
+new=$(echo "$new" | sed 's/./R/g')
+check "bitmap update in place" "Updated 1 tuples (0 moved)" \
+	"$(./update T "$k,?,?" "?,?,$new" | grep Updated)"
+check "select through bitmap after update" "$(echo "$t" | cut -d, -f1,2),$new" \
+	"$(./select T "?,?,$new" | grep ,)"
+check "bitmap used" "yes" \
+	"$(./select --explain --count T "?,?,$new" | grep -q "bitmap indexes on attributes 2" && echo yes)"
+
+# the default choice vector gives an order-preserving attribute
+# the top bits of its values' places, so a range is not a full scan
+rm -f T.*
+./create --ordered 0:0:10000 T 3 4 "" >/dev/null
+./gendata 3000 3 5 | ./insert T >/dev/null
+x=$(./select --explain --count T "2000..2080,?,?")
+check "range matches" "81" "$(echo "$x" | grep -v :)"
+check "range not a full scan" "candidate buckets: 16 of 90" \
+	"$(echo "$x" | grep "candidate buckets")"
+
+# merges don't go below the size a file was created with
+rm -f T.*
+./create T 3 64 "" >/dev/null
+./gendata 300 3 | ./insert T >/dev/null
+check "no merge below created size" "Deleted 1 tuples" "$(./delete T "1,?,?")"
+check "created size kept" "64" "$(./stats T | sed -n 's/.*#pages:\([0-9]*\).*/\1/p')"
+
+# nor do splits and merges undo each other near one load
+rm -f T.*
+./create --ordered 0:0:10000 T 3 1 "" >/dev/null
+./gendata 2000 3 5 | ./insert T >/dev/null
+check "merge when under a quarter full" "Merged 7 buckets" \
+	"$(./delete T "1..1560,?,?" | grep Merged)"
+./gendata 34 3 5000 | ./insert T >/dev/null
+check "no split just after a merge" "52" "$(./stats T | sed -n 's/.*#pages:\([0-9]*\).*/\1/p')"
+check "no merge just after inserts" "Deleted 1 tuples" "$(./delete T "5000,?,?")"
+
+# a relation made by another version (here: no header version,
+# and no .shadow, as the original tools made them) is refused
+# (the version is the header's 14th count, at byte 52)
+rm -f T.*
+./create T 3 2 "" >/dev/null
+printf '\0\0\0\0' | dd of=T.info bs=1 seek=52 conv=notrunc 2>/dev/null
+rm -f T.shadow
+check "other version refused" "T was made by another version of this program; create it again" \
+	"$(./select T "?,?,?" 2>&1 | head -1)"
+
+rm -f T.*
+exit $fail
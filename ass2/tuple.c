@@ -9,6 +9,8 @@
 #include "chvec.h"
 #include "bits.h"
 
+static Bits hashTuple(Reln r, Tuple t, HashMemo m);
+
 // return number of bytes/chars in a tuple
 
 int tupLength(Tuple t)
@@ -66,35 +68,77 @@ void freeVals( char **_vals, int _nvals )
 }
 
 Bits tupleHash(Reln r, Tuple t)
+{
+	return tupleHashMemo(r, t, hashMemo(r));
+}
+
+// tupleHash() using a given memo of value hashes (or NULL for none)
+// lets a thread keep its own memo, separate from the relation's
+
+Bits tupleHashMemo(Reln r, Tuple t, HashMemo m)
 {
 	char buf[MAXBITS+1];
+	Bits hash = hashTuple(r, t, m);
+	bitsString(hash,buf);
+	printf("hash(%s) = %s\n", t, buf);
+	return hash;
+}
+
+// tupleHash() without the trace output, for scans
+
+Bits tupleHashQuiet(Reln r, Tuple t)
+{
+	return hashTuple(r, t, hashMemo(r));
+}
+
+static Bits hashTuple(Reln r, Tuple t, HashMemo m)
+{
 	Count nvals = nattrs(r);
 	char **vals = malloc(nvals*sizeof(char *));
 	assert(vals != NULL);
 	tupleVals(t, vals);
 
-	// Bits hash = hash_any((unsigned char *)vals[0],strlen(vals[0])); 
-	// Let hash contains new bits chosen by choicde vector
-	Bits hash = 0;
+	// hash each attribute that the choice vector uses, then
+	// let the compiled plan gather the chosen bits into one hash
+	ChVecPlan *plan = chvecPlan(r);
+	OrderSpec *o = orderSpec(r);
 	Bits hashes[ nvals ];
-	// store each attributes' hash value
+	Bits used = 0;
 	for( int i = 0 ; i < nvals ; i++ ) {
-		hashes[ i ] =  hash_any((unsigned char *)vals[ i ],strlen(vals[ i ])); 
-	}
-
-	for( int i = 0 ; i < 32 ; i++ ) {
-		/**
-		 * Attention : if time is limited, then put two expression into one
-		 */
-		Bits extracted_bit =  ( ( hashes[ chvec(r)[i].att ] &  ( 1 <<  chvec(r)[i].bit ) ) >>  chvec(r)[i].bit ) ;
-		hash = hash | ( extracted_bit << i );
+		if( plan->dst[ i ] == 0 ) continue;
+		if( bitAt( o->attrs, i ) )
+			hashes[ i ] = orderHash( vals[ i ], o->lo[ i ], o->hi[ i ] );
+		else
+			hashes[ i ] = ( m != NULL ) ? memoHash( m, (unsigned char *)vals[ i ], strlen(vals[ i ]) )
+			                            : hashfn(r)( (unsigned char *)vals[ i ], strlen(vals[ i ]) );
+		used |= 1u << i;
 	}
-	bitsString(hash,buf);
-	printf("hash(%s) = %s\n", t, buf);
+	Bits hash = chvecGather( plan, hashes, used );
 	freeVals( vals, nvals );
 	return hash;
 }
 
+// hash a single attribute value, using the relation's hash function
+// (via the relation's memo of previous values, if it has one)
+
+Bits valueHash(Reln r, char *val)
+{
+	HashMemo m = hashMemo(r);
+	if (m != NULL) return memoHash(m, (unsigned char *)val, strlen(val));
+	return hashfn(r)((unsigned char *)val, strlen(val));
+}
+
+// the hash that attribute a's bits in the choice vector come
+// from: valueHash(), unless a is order-preserving
+// (valueHash() still identifies values, e.g. in page filters)
+
+Bits attrHash(Reln r, Count a, char *val)
+{
+	OrderSpec *o = orderSpec(r);
+	if (bitAt(o->attrs, a)) return orderHash(val, o->lo[a], o->hi[a]);
+	return valueHash(r, val);
+}
+
 // compare two tuples (allowing for "unknown" values)
 // assume t1 is query, t2 is tuples from disk
 Bool tupleMatch(Reln r, Tuple t1, Tuple t2)
@@ -10,12 +10,21 @@
 
 typedef char *Tuple;
 
+// a deleted tuple stays in its page (same length), but with
+// its first char overwritten by TOMBSTONE, until compaction
+#define TOMBSTONE '\177'
+
 #include "reln.h"
 #include "bits.h"
+#include "hash.h"
 
 int tupLength(Tuple t);
 Tuple readTuple(Reln r, FILE *in);
 Bits tupleHash(Reln r, Tuple t);
+Bits tupleHashMemo(Reln r, Tuple t, HashMemo m);
+Bits tupleHashQuiet(Reln r, Tuple t);
+Bits valueHash(Reln r, char *val);
+Bits attrHash(Reln r, Count a, char *val);
 void tupleVals(Tuple t, char **vals);
 void freeVals(char **vals, int nattrs);
 Bool tupleMatch(Reln r, Tuple t1, Tuple t2);
@@ -0,0 +1,136 @@
+// update.c ... change tuples in a relation
+// part of Multi-attribute linear-hashed files
+// Change all tuples matching a partial-match query
+// Usage:  ./update  [-v]  RelName  v1,v2,v3,...  n1,n2,n3,...
+// where any of the vi's can be "?" (unknown) or a list of values
+//   "a|b|c" (any of them) or range "lo..hi" (as for select), and the
+//   ni's are new values ("?" keeps the old value)
+// Tuples whose hash doesn't change (and whose length doesn't)
+//   are changed in place; others are deleted and re-inserted
+// Key attributes (see create) can't be changed
+
+#include "defs.h"
+#include "query.h"
+#include "tuple.h"
+#include "reln.h"
+
+#define USAGE "./update  [-v]  RelName  v1,v2,v3,...  n1,n2,n3,..."
+
+static Tuple newVersion(Reln r, Tuple old, char *nvals);
+
+// Main ... process args, change matching tuples
+
+int main(int argc, char **argv)
+{
+	Reln r;  // handle on the open relation
+	Query q;  // processed version of query string
+	Tuple t;  // tuple pointer
+	char err[MAXERRMSG];  // buffer for error messages
+	int verbose;  // show each changed tuple
+	char *rname;  // name of table/file
+	char *qstr;   // query string
+	char *nstr;   // new values
+
+	// process command-line args
+
+	int arg = 1;
+	verbose = 0;
+	if (argc > 1 && strcmp(argv[1], "-v") == 0) {
+		verbose = 1;  arg++;
+	}
+	if (argc - arg < 3) fatal(USAGE);
+	rname = argv[arg];  qstr = argv[arg+1];  nstr = argv[arg+2];
+
+	// initialise relation and scanning structure
+
+	if (!existsRelation(rname)) {
+		sprintf(err, "No such relation: %s",rname);
+		fatal(err);
+	}
+	if ((r = openRelation(rname,"r+")) == NULL) {
+		sprintf(err, "Can't open relation: %s",rname);
+		fatal(err);
+	}
+	Count ncommas = 0;
+	for (char *c = nstr; *c != '\0'; c++) ncommas += (*c == ',');
+	if (ncommas+1 != nattrs(r)) {
+		sprintf(err, "Invalid new values: %s",nstr);
+		fatal(err);
+	}
+	// in-place changes aren't checked against the key, so don't
+	//   allow any to it (delete and insert the tuple instead)
+	char **nv = malloc(nattrs(r)*sizeof(char *));
+	assert(nv != NULL);
+	tupleVals(nstr, nv);
+	for (Count i = 0; i < nattrs(r); i++)
+		if (bitAt(keyAttrs(r), i) && strcmp(nv[i], "?") != 0)
+			fatal("Can't change key attributes");
+	freeVals(nv, nattrs(r));
+	if ((q = startUpdate(r, qstr)) == NULL) {
+		sprintf(err, "Invalid query: %s",qstr);
+		fatal(err);
+	}
+
+	// change matching tuples in place where possible; the others
+	//   are re-inserted after the scan, so it can't find them again
+
+	Count nchanged = 0, nmoved = 0;
+	Tuple *moved = NULL;
+	while ((t = getNextTuple(q)) != NULL) {
+		Tuple nt = newVersion(r, t, nstr);
+		if (verbose) printf("%s -> %s\n", t, nt);
+		nchanged++;
+		if (tupleHashQuiet(r,t) == tupleHashQuiet(r,nt)
+		    && replaceCurrentTuple(q, nt) == OK) {
+			free(nt);
+		}
+		else {
+			deleteCurrentTuple(q);
+			moved = realloc(moved, (nmoved+1)*sizeof(Tuple));
+			assert(moved != NULL);
+			moved[nmoved++] = nt;
+		}
+		free(t);
+	}
+	closeQuery(q);
+
+	for (Count i = 0; i < nmoved; i++) {
+		PageID p = addToRelation(r, moved[i]);
+		if (p == NO_PAGE || p == DUPLICATE_KEY) {
+			sprintf(err, "Insert of %.50s failed", moved[i]);
+			fatal(err);
+		}
+		free(moved[i]);
+	}
+	free(moved);
+	printf("Updated %d tuples (%d moved)\n", nchanged, nmoved);
+	shrinkRelation(r);
+
+	// clean up
+
+	closeRelation(r);
+
+	return 0;
+}
+
+// old tuple, with values from nvals except where they're "?"
+
+static Tuple newVersion(Reln r, Tuple old, char *nvals)
+{
+	Count n = nattrs(r);
+	char **ov = malloc(n*sizeof(char *));
+	char **nv = malloc(n*sizeof(char *));
+	assert(ov != NULL && nv != NULL);
+	tupleVals(old, ov);
+	tupleVals(nvals, nv);
+	Tuple t = malloc(MAXTUPLEN);
+	assert(t != NULL);
+	t[0] = '\0';
+	for (Count i = 0; i < n; i++) {
+		if (i > 0) strcat(t, ",");
+		strcat(t, (strcmp(nv[i], "?") == 0) ? ov[i] : nv[i]);
+	}
+	freeVals(ov, n);
+	freeVals(nv, n);
+	return t;
+}
@@ -0,0 +1,363 @@
+// wal.c ... write-ahead log with group commit
+// part of Multi-attribute Linear-hashed Files
+// A Wal tracks a few files (e.g. a relation's data, ovflow and
+//   info files); every write to them is held in memory until
+//   the next commit, which
+//   1. appends full images of all changed pages to the log,
+//      followed by a commit record, and fsyncs the log once
+//   2. writes the same images into the files themselves
+// A checkpoint fsyncs the files, after which the log can be
+//   emptied. If a process dies, replaying the complete groups
+//   in the log (in order) redoes everything it committed.
+
+#define _POSIX_C_SOURCE 200112L
+#include <unistd.h>
+#include "defs.h"
+#include "wal.h"
+#include "hash.h"
+
+#define WALFILES  5    // max #files tracked by one log
+#define WALSLOTS  1024 // hash table of pending changes
+#define WALCOMMIT 0xffffffff  // file id of record ending a group
+
+// a record in the log, followed by len bytes of data
+// a commit record has off = #records in the group, len = 0
+typedef struct {
+	Count  file;  // index in files[], or WALCOMMIT
+	Offset off;   // where the bytes go in the file
+	Count  len;
+	Bits   sum;   // checksum of all the above, plus the data
+} WalRec;
+
+// a change to a file, waiting for the next commit
+typedef struct WalChange {
+	Count  file;
+	Offset off;
+	Count  len;
+	char  *bytes;
+	struct WalChange *next;      // in hash chain
+	struct WalChange *nextDirty; // in list of all changes
+} WalChange;
+
+struct WalRep {
+	FILE  *log;
+	FILE  *files[WALFILES];
+	int    nfiles;
+	PageID end[WALFILES];   // #pages in each file, counting pending ones
+	WalChange *table[WALSLOTS];
+	WalChange *dirty;       // all pending changes
+	Count  ndirty;
+};
+
+// the log that page reads/writes are currently routed to
+static Wal tracking = NULL;
+
+static Bool replay(FILE *log, FILE **files, int nfiles);
+static Bits recSum(WalRec *rec, char *bytes);
+static void syncFile(FILE *f);
+
+// open the log in fname, first redoing any groups left in it
+// then track all writes to files[0..nfiles-1] until closeWal()
+// only one Wal may be open at a time
+
+Wal openWal(char *fname, FILE **files, int nfiles)
+{
+	assert(tracking == NULL && nfiles <= WALFILES);
+	Wal w = malloc(sizeof(struct WalRep));
+	assert(w != NULL);
+	w->log = fopen(fname, "a+");
+	assert(w->log != NULL);
+	replay(w->log, files, nfiles);
+	w->nfiles = nfiles;
+	for (int i = 0; i < nfiles; i++) {
+		w->files[i] = files[i];
+		fseek(files[i], 0, SEEK_END);
+		w->end[i] = ftell(files[i])/PAGESIZE;
+	}
+	for (int i = 0; i < WALSLOTS; i++) w->table[i] = NULL;
+	w->dirty = NULL;
+	w->ndirty = 0;
+	tracking = w;
+	return w;
+}
+
+// stop tracking; pending changes are dropped, so callers
+//   normally commit (and checkpoint) first
+
+void closeWal(Wal w)
+{
+	WalChange *c, *next;
+	for (c = w->dirty; c != NULL; c = next) {
+		next = c->nextDirty;
+		free(c->bytes);
+		free(c);
+	}
+	fclose(w->log);
+	tracking = NULL;
+	free(w);
+}
+
+static int fileId(Wal w, FILE *f)
+{
+	for (int i = 0; i < w->nfiles; i++)
+		if (w->files[i] == f) return i;
+	return -1;
+}
+
+static WalChange **slotFor(Wal w, Count file, Offset off)
+{
+	return &w->table[(file*31 + off/PAGESIZE) % WALSLOTS];
+}
+
+static WalChange *findChange(Wal w, Count file, Offset off)
+{
+	WalChange *c;
+	for (c = *slotFor(w,file,off); c != NULL; c = c->next)
+		if (c->file == file && c->off == off) return c;
+	return NULL;
+}
+
+// record that bytes (which we now own) go at off in file
+// replaces any earlier change at the same place
+
+static void putChange(Wal w, Count file, Offset off, char *bytes, Count len)
+{
+	WalChange *c = findChange(w, file, off);
+	if (c != NULL) {
+		assert(c->len == len);
+		free(c->bytes);
+		c->bytes = bytes;
+		return;
+	}
+	c = malloc(sizeof(WalChange));
+	assert(c != NULL);
+	c->file = file;  c->off = off;  c->len = len;  c->bytes = bytes;
+	WalChange **slot = slotFor(w, file, off);
+	c->next = *slot;  *slot = c;
+	c->nextDirty = w->dirty;  w->dirty = c;
+	w->ndirty++;
+	PageID last = (off+len-1)/PAGESIZE;
+	if (last >= w->end[file]) w->end[file] = last+1;
+}
+
+// write len bytes at off in f, at the next commit
+// f must be one of the files tracked by w
+
+void walPutBytes(Wal w, FILE *f, Offset off, void *buf, Count len)
+{
+	int id = fileId(w, f);
+	assert(id >= 0);
+	char *bytes = malloc(len);
+	assert(bytes != NULL);
+	memcpy(bytes, buf, len);
+	putChange(w, id, off, bytes, len);
+}
+
+// #changes waiting for commit
+
+Count walDirty(Wal w)
+{
+	return w->ndirty;
+}
+
+// append all pending changes to the log as one group,
+// and make them durable with a single fsync
+
+void walLog(Wal w)
+{
+	WalRec rec;
+	WalChange *c;
+	for (c = w->dirty; c != NULL; c = c->nextDirty) {
+		rec.file = c->file;  rec.off = c->off;  rec.len = c->len;
+		rec.sum = recSum(&rec, c->bytes);
+		int n = fwrite(&rec, sizeof(WalRec), 1, w->log);
+		assert(n == 1);
+		n = fwrite(c->bytes, 1, c->len, w->log);
+		assert(n == c->len);
+	}
+	rec.file = WALCOMMIT;  rec.off = w->ndirty;  rec.len = 0;
+	rec.sum = recSum(&rec, NULL);
+	int n = fwrite(&rec, sizeof(WalRec), 1, w->log);
+	assert(n == 1);
+	syncFile(w->log);
+}
+
+// write the pending changes (already logged) to their files
+
+void walApply(Wal w)
+{
+	WalChange *c, *next;
+	for (c = w->dirty; c != NULL; c = next) {
+		next = c->nextDirty;
+		FILE *f = w->files[c->file];
+		int ok = fseek(f, c->off, SEEK_SET);
+		assert(ok == 0);
+		int n = fwrite(c->bytes, 1, c->len, f);
+		assert(n == c->len);
+		free(c->bytes);
+		free(c);
+	}
+	for (int i = 0; i < w->nfiles; i++) fflush(w->files[i]);
+	for (int i = 0; i < WALSLOTS; i++) w->table[i] = NULL;
+	w->dirty = NULL;
+	w->ndirty = 0;
+}
+
+// #bytes in the log since the last checkpoint
+
+Offset walSize(Wal w)
+{
+	fseek(w->log, 0, SEEK_END);
+	return ftell(w->log);
+}
+
+// make everything applied so far durable in the files
+//   themselves, after which the log isn't needed
+
+void walCheckpoint(Wal w)
+{
+	for (int i = 0; i < w->nfiles; i++) syncFile(w->files[i]);
+	int ok = ftruncate(fileno(w->log), 0);
+	assert(ok == 0);
+	syncFile(w->log);
+}
+
+// is anything left in a log (an open handle on it, or NULL)?
+// if so, and nobody is still writing to it, it needs redoing
+
+Bool walPending(FILE *log)
+{
+	if (log == NULL) return FALSE;
+	fseek(log, 0, SEEK_END);
+	return ftell(log) > 0;
+}
+
+// redo the log into files[0..nfiles-1], and empty it
+// caller makes sure nobody is still writing to the log
+// returns TRUE if anything was redone
+
+Bool walRedo(FILE *log, FILE **files, int nfiles)
+{
+	return replay(log, files, nfiles);
+}
+
+// apply each complete group in the log, in order, then
+// empty it; stops at the first torn or partial group
+
+static Bool replay(FILE *log, FILE **files, int nfiles)
+{
+	WalRec rec;
+	WalChange *group = NULL, *c;
+	Count ngroup = 0;
+	Bool redone = FALSE;
+
+	fseek(log, 0, SEEK_SET);
+	while (fread(&rec, sizeof(WalRec), 1, log) == 1) {
+		if (rec.file == WALCOMMIT) {
+			if (rec.sum != recSum(&rec, NULL) || rec.off != ngroup) break;
+			for (c = group; c != NULL; c = c->next) {
+				fseek(files[c->file], c->off, SEEK_SET);
+				fwrite(c->bytes, 1, c->len, files[c->file]);
+			}
+			redone = redone || ngroup > 0;
+		}
+		else if (rec.file < nfiles && rec.len <= PAGESIZE) {
+			c = malloc(sizeof(WalChange));
+			assert(c != NULL);
+			c->bytes = malloc(rec.len);
+			assert(c->bytes != NULL);
+			c->file = rec.file;  c->off = rec.off;  c->len = rec.len;
+			c->next = group;  group = c;
+			ngroup++;
+			if (fread(c->bytes, 1, rec.len, log) != rec.len
+			    || rec.sum != recSum(&rec, c->bytes))
+				break;
+			continue;
+		}
+		else
+			break;
+		// group done; each place in a file appears in it at
+		//   most once, so the order within it doesn't matter
+		while (group != NULL) {
+			c = group->next;
+			free(group->bytes);
+			free(group);
+			group = c;
+		}
+		ngroup = 0;
+	}
+	while (group != NULL) {
+		c = group->next;
+		free(group->bytes);
+		free(group);
+		group = c;
+	}
+
+	if (redone)
+		for (int i = 0; i < nfiles; i++) syncFile(files[i]);
+	int ok = ftruncate(fileno(log), 0);
+	assert(ok == 0);
+	syncFile(log);
+	return redone;
+}
+
+static Bits recSum(WalRec *rec, char *bytes)
+{
+	Bits sum = hash_any((unsigned char *)rec, 3*sizeof(Count));
+	if (bytes != NULL && rec->len > 0)
+		sum ^= hash_any((unsigned char *)bytes, rec->len);
+	return sum;
+}
+
+static void syncFile(FILE *f)
+{
+	fflush(f);
+	int ok = fsync(fileno(f));
+	assert(ok == 0);
+}
+
+// hooks for page.c
+
+// copy (the first len bytes of) page pid of f into buf,
+// if a change to it is waiting for commit
+
+Bool walGetPage(FILE *f, PageID pid, void *buf, Count len)
+{
+	return walGetBytes(f, pid*PAGESIZE, buf, len);
+}
+
+// as for walGetPage(), for files written in records that aren't
+// whole pages (e.g. R.bloom); off is where the record starts
+
+Bool walGetBytes(FILE *f, Offset off, void *buf, Count len)
+{
+	if (tracking == NULL) return FALSE;
+	int id = fileId(tracking, f);
+	if (id < 0) return FALSE;
+	WalChange *c = findChange(tracking, id, off);
+	if (c == NULL) return FALSE;
+	memcpy(buf, c->bytes, len);
+	return TRUE;
+}
+
+// hold page pid of f until commit; takes over pg
+
+Bool walPutPage(FILE *f, PageID pid, void *pg)
+{
+	if (tracking == NULL) return FALSE;
+	int id = fileId(tracking, f);
+	if (id < 0) return FALSE;
+	putChange(tracking, id, pid*PAGESIZE, pg, PAGESIZE);
+	return TRUE;
+}
+
+// #pages in f, including any appended since the last commit
+
+Bool walFileEnd(FILE *f, PageID *npages)
+{
+	if (tracking == NULL) return FALSE;
+	int id = fileId(tracking, f);
+	if (id < 0) return FALSE;
+	*npages = tracking->end[id];
+	return TRUE;
+}
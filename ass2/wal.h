@@ -0,0 +1,31 @@
+// wal.h ... interface to the write-ahead log
+// part of Multi-attribute Linear-hashed Files
+// Writes to tracked files are held in memory (no-steal) until
+//   a group commit logs them all with one fsync, then applies them
+// See wal.c for details on functions
+
+#ifndef WAL_H
+#define WAL_H 1
+
+typedef struct WalRep *Wal;
+
+#include "defs.h"
+
+Wal openWal(char *fname, FILE **files, int nfiles);
+void closeWal(Wal w);
+void walPutBytes(Wal w, FILE *f, Offset off, void *buf, Count len);
+Count walDirty(Wal w);
+void walLog(Wal w);
+void walApply(Wal w);
+Offset walSize(Wal w);
+void walCheckpoint(Wal w);
+Bool walPending(FILE *log);
+Bool walRedo(FILE *log, FILE **files, int nfiles);
+
+// hooks for the page layer; all return FALSE if f isn't tracked
+Bool walGetPage(FILE *f, PageID pid, void *buf, Count len);
+Bool walGetBytes(FILE *f, Offset off, void *buf, Count len);
+Bool walPutPage(FILE *f, PageID pid, void *pg);
+Bool walFileEnd(FILE *f, PageID *npages);
+
+#endif